@@ -0,0 +1,201 @@
+#include "pch.h"
+
+#include "Correlator.h"
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Correlator implementation
+	Correlator::Correlator() : byId(false), maxShell(0), threads(0), m_rows(0), m_cols(0), m_nShells(0)
+	{
+	}
+
+	void Correlator::analyse(const GenView& view)
+	{
+		NZG_PROF_SCOPE("Correlator::analyse");
+		m_curves.clear();
+		if (view.rows <= 0 || view.cols <= 0)
+			return;
+
+		m_pool.setThreads(threads);
+		setSize(view.rows, view.cols);
+
+		std::vector<int64_t> counts(view.strats->getCount(), 0);
+		int64_t nCells = (int64_t)view.rows * view.cols;
+		for (int64_t i = 0; i < nCells; i++)
+			counts[view.types[i]]++;
+
+		// Curve of every type id, -1 for the ids no cell holds
+		std::vector<int> groups(counts.size(), -1);
+		std::vector<int> curves((int)Strat::Type::maxType + 1, -1);
+		for (size_t id = 0; id < counts.size(); id++)
+		{
+			if (counts[id] == 0)
+				continue;
+
+			bool bGenome = view.strats->isGenome((TypeId)id);
+			TypeId type = byId || !bGenome ? (TypeId)id : (TypeId)Strat::Type::genome;
+			int& nCurve = byId ? groups[id] : curves[std::min((int)type, (int)Strat::Type::maxType)];
+			if (nCurve < 0)
+			{
+				nCurve = (int)m_curves.size();
+				Curve c;
+				c.type = type;
+				c.name = byId || !bGenome ? view.strats->get(type).getName() : std::string("genomes");
+				c.count = 0;
+				m_curves.push_back(c);
+			}
+			groups[id] = nCurve;
+			m_curves[nCurve].count += counts[id];
+		}
+
+		for (size_t i = 0; i < m_curves.size(); i += 2)
+			analysePair(view, groups, (int)i, i + 1 < m_curves.size() ? (int)i + 1 : -1);
+	}
+
+	void Correlator::setSize(int rows, int cols)
+	{
+		int nShells = maxShell > 0 ? maxShell : std::min(rows, cols) / 2;
+		if (rows == m_rows && cols == m_cols && nShells == m_nShells)
+			return;
+
+		m_rows = rows;
+		m_cols = cols;
+		m_nShells = nShells;
+		m_fft.setSize(rows, cols);
+		m_plane.resize((size_t)rows * cols);
+		m_dShells.resize((size_t)rows * cols);
+		m_kShells.resize((size_t)rows * cols);
+		m_dCounts.assign(nShells + 1, 0);
+		m_kCounts.assign(nShells + 1, 0);
+
+		int nMin = std::min(rows, cols);
+		for (int i = 0; i < rows; i++)
+		{
+			int di = std::min(i, rows - i);
+			double ki = (i <= rows / 2 ? i : i - rows) / (double)rows;
+			for (int j = 0; j < cols; j++)
+			{
+				int dj = std::min(j, cols - j);
+				int s = (int)std::lround(std::sqrt((double)di * di + (double)dj * dj));
+				s = s <= nShells ? s : -1;
+				m_dShells[(size_t)i * cols + j] = s;
+				if (s >= 0)
+					m_dCounts[s]++;
+
+				double kj = (j <= cols / 2 ? j : j - cols) / (double)cols;
+				s = (int)std::lround(nMin * std::sqrt(ki * ki + kj * kj));
+				s = (i == 0 && j == 0) || s > nShells ? -1 : s;
+				m_kShells[(size_t)i * cols + j] = s;
+				if (s >= 0)
+					m_kCounts[s]++;
+			}
+		}
+	}
+
+	// Curves a and b (none for -1) from one complex transform of n_a + i n_b
+	void Correlator::analysePair(const GenView& view, const std::vector<int>& groups, int a, int b)
+	{
+		int rows = m_rows;
+		int cols = m_cols;
+		int nShells = m_nShells + 1;
+		m_sums.resize(m_pool.getThreads());
+		for (auto& sums : m_sums)
+			sums.assign(4 * nShells, 0);
+
+		m_pool.parallelFor(rows, [&](int row0, int row1, int) {
+			for (int i = row0; i < row1; i++)
+			{
+				const TypeId* pTypes = view.types + (size_t)i * cols;
+				Complex* pPlane = m_plane.data() + (size_t)i * cols;
+				for (int j = 0; j < cols; j++)
+				{
+					int g = groups[pTypes[j]];
+					pPlane[j] = Complex(g == a ? 1.0 : 0.0, g == b ? 1.0 : 0.0);
+				}
+			}
+		});
+
+		m_fft.transform(m_plane.data(), false, m_pool);
+
+		// Fields are real, so F(-k) = conj(F(k)) for both: with Z = F_a + i F_b,
+		// F_a(k) = (Z(k) + conj(Z(-k))) / 2 and F_b(k) = (Z(k) - conj(Z(-k))) / 2i.
+		// The power spectra are even, k and -k are done together and written to both.
+		m_pool.run(rows / 2 + 1, [&](int i, int thread) {
+			int i2 = (rows - i) % rows;
+			Complex* pRow = m_plane.data() + (size_t)i * cols;
+			Complex* pRow2 = m_plane.data() + (size_t)i2 * cols;
+			double* pSums = m_sums[thread].data();
+			int nCols = i == i2 ? cols / 2 + 1 : cols;
+			for (int j = 0; j < nCols; j++)
+			{
+				int j2 = (cols - j) % cols;
+				Complex z = pRow[j];
+				Complex zm = std::conj(pRow2[j2]);
+				double pa = std::norm(z + zm) * 0.25;
+				double pb = std::norm(z - zm) * 0.25;
+				pRow[j] = pRow2[j2] = Complex(pa, pb);
+
+				int s = m_kShells[(size_t)i * cols + j];
+				if (s >= 0)
+				{
+					double w = i == i2 && j == j2 ? 1 : 2;
+					pSums[s] += w * pa;
+					pSums[nShells + s] += w * pb;
+				}
+			}
+		});
+
+		// Both power spectra are real and even, so are their transforms
+		m_fft.transform(m_plane.data(), true, m_pool);
+
+		m_pool.parallelFor(rows, [&](int row0, int row1, int thread) {
+			double* pSums = m_sums[thread].data() + 2 * nShells;
+			for (int i = row0; i < row1; i++)
+			{
+				const Complex* pPlane = m_plane.data() + (size_t)i * cols;
+				const int* pShells = m_dShells.data() + (size_t)i * cols;
+				for (int j = 0; j < cols; j++)
+				{
+					int s = pShells[j];
+					if (s >= 0)
+					{
+						pSums[s] += pPlane[j].real();
+						pSums[nShells + s] += pPlane[j].imag();
+					}
+				}
+			}
+		});
+
+		double nCells = (double)rows * cols;
+		for (int k = 0; k < 2; k++)
+		{
+			int c = k == 0 ? a : b;
+			if (c < 0)
+				continue;
+
+			Curve& curve = m_curves[c];
+			double n = (double)curve.count;
+			curve.density = n / nCells;
+			reduce(curve.structure, k * nShells, m_kCounts, 1 / n);
+			reduce(curve.correlation, (2 + k) * nShells, m_dCounts, 1 / (n * n));
+		}
+	}
+
+	// Shell means of the per thread sums at nOffset, times scale
+	void Correlator::reduce(std::vector<double>& curve, int nOffset, const std::vector<double>& counts, double scale) const
+	{
+		curve.assign(counts.size(), 0);
+		for (size_t s = 0; s < counts.size(); s++)
+		{
+			if (counts[s] == 0)
+				continue;
+			double sum = 0;
+			for (auto& sums : m_sums)
+				sum += sums[nOffset + s];
+			curve[s] = sum / counts[s] * scale;
+		}
+	}
+	// End of Correlator implementation
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "NzgNode.h"
+#include "Fft.h"
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////
+	// Correlator - spatial structure of the map by way of the indicator field n(x) of
+	// every type (1 where a cell holds it). On the periodic grid of N cells, with the
+	// density rho = sum n / N and F(k) the 2D transform of n:
+	//
+	//   pair correlation  g(d) = (1/N) sum_x n(x) n(x+d) / rho^2	(1 without structure)
+	//   structure factor  S(k) = |F(k)|^2 / sum n
+	//
+	// g is the inverse transform of |F|^2, so a type costs two 2D FFTs instead of the
+	// N^2 pairs. Two real fields share one complex transform, as the real and the
+	// imaginary part. Both are averaged over shells: g over |d| (minimum image) in
+	// steps of a cell, S over |k| in steps of the fundamental 2 pi / min(rows, cols).
+	class Correlator
+	{
+	// Construction:
+	public:
+		Correlator();
+
+		struct Curve
+		{
+			TypeId type;	// Strat::Type, or the type id with byId
+			std::string name;
+			int64_t count;	// Cells of the type
+			double density;
+			std::vector<double> correlation;	// g by shell of |d|, from 0 (1 / density)
+			std::vector<double> structure;		// S by shell of |k|, 0 for k = 0
+		};
+
+	// Attributes:
+	public:
+		bool byId;		// A curve per type id, otherwise all genomes make one Strat::Type::genome
+		int maxShell;	// Shells of the curves, 0 for min(rows, cols) / 2
+		int threads;	// 0 for all hardware threads
+
+		const std::vector<Curve>& getCurves() const { return m_curves; }
+
+	// Operations:
+	public:
+		void analyse(const GenView& view);
+
+	// Implementation:
+	protected:
+		std::vector<Curve> m_curves;
+		ThreadPool m_pool;
+		Fft2 m_fft;
+		std::vector<Complex> m_plane;
+		int m_rows;
+		int m_cols;
+		int m_nShells;
+		std::vector<int> m_dShells;	// Shell of every offset d, -1 past the last
+		std::vector<int> m_kShells;	// Shell of every wave vector k, -1 past the last and for k = 0
+		std::vector<double> m_dCounts;	// Offsets per shell
+		std::vector<double> m_kCounts;
+		std::vector<std::vector<double>> m_sums;	// Per thread shell sums of two curves
+
+		void setSize(int rows, int cols);
+		void analysePair(const GenView& view, const std::vector<int>& groups, int a, int b);
+		void reduce(std::vector<double>& curve, int nOffset, const std::vector<double>& counts, double scale) const;
+	};
+	// End of Correlator
+	////////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,338 @@
+#include "pch.h"
+
+#include "Fft.h"
+
+namespace nzg
+{
+	namespace
+	{
+		const double c_pi = 3.14159265358979323846;
+
+		// Plain product, std::complex checks for infinities on every multiplication
+		inline Complex mul(const Complex& a, const Complex& b)
+		{
+			return Complex(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+		}
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Fft implementation
+	Fft::Fft(int n) : m_n(0)
+	{
+		setSize(n);
+	}
+
+	void Fft::setSize(int n)
+	{
+		m_n = std::max(n, 0);
+		m_factors.clear();
+		m_twiddles.clear();
+		m_pChirpFft.reset();
+		m_chirp.clear();
+		m_chirpSpectrum.clear();
+		if (m_n <= 1)
+		{
+			m_factors = { 1, 1 };
+			return;
+		}
+
+		// Radix 4 as long as it goes, then 2, then the odd factors from the smallest
+		int nLeft = m_n;
+		int p = 4;
+		bool bBluestein = false;
+		while (nLeft > 1)
+		{
+			while (nLeft % p != 0)
+			{
+				p = p == 4 ? 2 : p == 2 ? 3 : p + 2;
+				if ((int64_t)p * p > nLeft)
+					p = nLeft;
+			}
+			nLeft /= p;
+			m_factors.push_back(p);
+			m_factors.push_back(nLeft);
+			bBluestein |= p > c_maxRadix;
+		}
+
+		if (!bBluestein)
+		{
+			m_twiddles.resize(m_n);
+			for (int k = 0; k < m_n; k++)
+				m_twiddles[k] = std::polar(1.0, -2 * c_pi * k / m_n);
+			return;
+		}
+
+		m_factors.clear();
+		int nChirp = 1;
+		while (nChirp < 2 * m_n - 1)
+			nChirp *= 2;
+		m_pChirpFft = std::make_unique<Fft>(nChirp);
+
+		// k^2 taken mod 2n keeps the angle exact for long transforms
+		m_chirp.resize(m_n);
+		for (int k = 0; k < m_n; k++)
+			m_chirp[k] = std::polar(1.0, -c_pi * (double)((int64_t)k * k % (2 * m_n)) / m_n);
+
+		m_chirpSpectrum.assign(nChirp, Complex(0, 0));
+		m_chirpSpectrum[0] = std::conj(m_chirp[0]);
+		for (int k = 1; k < m_n; k++)
+			m_chirpSpectrum[k] = m_chirpSpectrum[nChirp - k] = std::conj(m_chirp[k]);
+		std::vector<Complex> scratch;
+		m_pChirpFft->transform(m_chirpSpectrum.data(), false, scratch);
+	}
+
+	void Fft::transform(Complex* data, bool bInverse, std::vector<Complex>& scratch) const
+	{
+		if (m_n <= 1)
+			return;
+		if (scratch.size() < getScratchSize())
+			scratch.resize(getScratchSize());
+
+		// The inverse is the conjugate of the transform of the conjugate
+		if (bInverse)
+		{
+			for (int k = 0; k < m_n; k++)
+				data[k] = std::conj(data[k]);
+		}
+		forward(data, scratch.data());
+		if (bInverse)
+		{
+			for (int k = 0; k < m_n; k++)
+				data[k] = std::conj(data[k]);
+		}
+	}
+
+	size_t Fft::getScratchSize() const
+	{
+		if (!m_pChirpFft)
+			return m_n;
+		return m_pChirpFft->getSize() + m_pChirpFft->getScratchSize();
+	}
+
+	void Fft::forward(Complex* data, Complex* scratch) const
+	{
+		if (!m_pChirpFft)
+		{
+			std::copy(data, data + m_n, scratch);
+			work(data, scratch, 1, m_factors.data());
+			return;
+		}
+
+		// X[k] = chirp[k] sum x[j] chirp[j] conj(chirp[k-j]), a cyclic convolution of length nChirp
+		int nChirp = m_pChirpFft->getSize();
+		Complex* a = scratch;
+		for (int k = 0; k < m_n; k++)
+			a[k] = mul(data[k], m_chirp[k]);
+		std::fill(a + m_n, a + nChirp, Complex(0, 0));
+
+		m_pChirpFft->forward(a, scratch + nChirp);
+		for (int k = 0; k < nChirp; k++)
+			a[k] = std::conj(mul(a[k], m_chirpSpectrum[k]));
+		m_pChirpFft->forward(a, scratch + nChirp);
+
+		double scale = 1.0 / nChirp;
+		for (int k = 0; k < m_n; k++)
+			data[k] = mul(m_chirp[k], std::conj(a[k])) * scale;
+	}
+
+	// Decimation in time: the p interleaved subsequences of length m are transformed
+	// into consecutive blocks of out, then combined by radix p butterflies
+	void Fft::work(Complex* out, const Complex* in, size_t stride, const int* factors) const
+	{
+		int p = factors[0];
+		int m = factors[1];
+		Complex* pEnd = out + (size_t)p * m;
+		if (m == 1)
+		{
+			for (Complex* pOut = out; pOut != pEnd; pOut++, in += stride)
+				*pOut = *in;
+		}
+		else
+		{
+			for (Complex* pOut = out; pOut != pEnd; pOut += m, in += stride)
+				work(pOut, in, stride * p, factors + 2);
+		}
+
+		switch (p)
+		{
+		case 2:
+			butterfly2(out, stride, m);
+			break;
+		case 3:
+			butterfly3(out, stride, m);
+			break;
+		case 4:
+			butterfly4(out, stride, m);
+			break;
+		case 5:
+			butterfly5(out, stride, m);
+			break;
+		default:
+			butterfly(out, stride, m, p);
+			break;
+		}
+	}
+
+	void Fft::butterfly2(Complex* out, size_t stride, int m) const
+	{
+		const Complex* pTw = m_twiddles.data();
+		for (int k = 0; k < m; k++, pTw += stride)
+		{
+			Complex t = mul(out[k + m], *pTw);
+			out[k + m] = out[k] - t;
+			out[k] += t;
+		}
+	}
+
+	void Fft::butterfly3(Complex* out, size_t stride, int m) const
+	{
+		const Complex* pTw1 = m_twiddles.data();
+		const Complex* pTw2 = m_twiddles.data();
+		double sin3 = m_twiddles[stride * m].imag(); // -sin(2 pi/3)
+		for (int k = 0; k < m; k++, out++, pTw1 += stride, pTw2 += 2 * stride)
+		{
+			Complex s1 = mul(out[m], *pTw1);
+			Complex s2 = mul(out[2 * m], *pTw2);
+			Complex s3 = s1 + s2;
+			Complex s0 = (s1 - s2) * sin3;
+
+			Complex t = out[0] - s3 * 0.5;
+			out[0] += s3;
+			out[2 * m] = Complex(t.real() + s0.imag(), t.imag() - s0.real());
+			out[m] = Complex(t.real() - s0.imag(), t.imag() + s0.real());
+		}
+	}
+
+	void Fft::butterfly4(Complex* out, size_t stride, int m) const
+	{
+		const Complex* pTw1 = m_twiddles.data();
+		const Complex* pTw2 = m_twiddles.data();
+		const Complex* pTw3 = m_twiddles.data();
+		for (int k = 0; k < m; k++, out++, pTw1 += stride, pTw2 += 2 * stride, pTw3 += 3 * stride)
+		{
+			Complex s0 = mul(out[m], *pTw1);
+			Complex s1 = mul(out[2 * m], *pTw2);
+			Complex s2 = mul(out[3 * m], *pTw3);
+
+			Complex s5 = out[0] - s1;
+			Complex s4 = out[0] + s1;
+			Complex s3 = s0 + s2;
+			Complex d = s0 - s2;
+			out[0] = s4 + s3;
+			out[2 * m] = s4 - s3;
+			out[m] = Complex(s5.real() + d.imag(), s5.imag() - d.real());
+			out[3 * m] = Complex(s5.real() - d.imag(), s5.imag() + d.real());
+		}
+	}
+
+	void Fft::butterfly5(Complex* out, size_t stride, int m) const
+	{
+		Complex ya = m_twiddles[stride * m];		// exp(-2 pi i/5)
+		Complex yb = m_twiddles[2 * stride * m];	// exp(-4 pi i/5)
+		for (int u = 0; u < m; u++, out++)
+		{
+			Complex s0 = out[0];
+			Complex s1 = mul(out[m], m_twiddles[u * stride]);
+			Complex s2 = mul(out[2 * m], m_twiddles[2 * u * stride]);
+			Complex s3 = mul(out[3 * m], m_twiddles[3 * u * stride]);
+			Complex s4 = mul(out[4 * m], m_twiddles[4 * u * stride]);
+
+			Complex s7 = s1 + s4;
+			Complex s10 = s1 - s4;
+			Complex s8 = s2 + s3;
+			Complex s9 = s2 - s3;
+			out[0] = s0 + s7 + s8;
+
+			Complex s5 = s0 + s7 * ya.real() + s8 * yb.real();
+			Complex s6(s10.imag() * ya.imag() + s9.imag() * yb.imag(), -(s10.real() * ya.imag() + s9.real() * yb.imag()));
+			out[m] = s5 - s6;
+			out[4 * m] = s5 + s6;
+
+			Complex s11 = s0 + s7 * yb.real() + s8 * ya.real();
+			Complex s12(s9.imag() * ya.imag() - s10.imag() * yb.imag(), s10.real() * yb.imag() - s9.real() * ya.imag());
+			out[2 * m] = s11 + s12;
+			out[3 * m] = s11 - s12;
+		}
+	}
+
+	// Any radix up to c_maxRadix, as a direct DFT of the p twiddled values
+	void Fft::butterfly(Complex* out, size_t stride, int m, int p) const
+	{
+		Complex values[c_maxRadix];
+		for (int u = 0; u < m; u++)
+		{
+			for (int q = 0, k = u; q < p; q++, k += m)
+				values[q] = out[k];
+
+			for (int q = 0, k = u; q < p; q++, k += m)
+			{
+				size_t nTw = 0;
+				Complex sum = values[0];
+				for (int j = 1; j < p; j++)
+				{
+					nTw += stride * k;
+					if (nTw >= (size_t)m_n)
+						nTw -= m_n;
+					sum += mul(values[j], m_twiddles[nTw]);
+				}
+				out[k] = sum;
+			}
+		}
+	}
+	// End of Fft implementation
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Fft2 implementation
+	Fft2::Fft2()
+	{
+	}
+
+	void Fft2::setSize(int rows, int cols)
+	{
+		if (rows != getRows())
+			m_colFft.setSize(rows);
+		if (cols != getCols())
+			m_rowFft.setSize(cols);
+	}
+
+	void Fft2::transform(Complex* plane, bool bInverse, ThreadPool& pool)
+	{
+		int rows = getRows();
+		int cols = getCols();
+		m_scratch.resize(pool.getThreads());
+		m_columns.resize(pool.getThreads());
+
+		pool.parallelFor(rows, [&](int row0, int row1, int thread) {
+			for (int i = row0; i < row1; i++)
+				m_rowFft.transform(plane + (size_t)i * cols, bInverse, m_scratch[thread]);
+		});
+
+		int nBlocks = (cols + c_colBlock - 1) / c_colBlock;
+		pool.parallelFor(nBlocks, [&](int block0, int block1, int thread) {
+			std::vector<Complex>& columns = m_columns[thread];
+			columns.resize((size_t)rows * c_colBlock);
+			for (int b = block0; b < block1; b++)
+			{
+				int col0 = b * c_colBlock;
+				int nCols = std::min((int)c_colBlock, cols - col0);
+				for (int i = 0; i < rows; i++)
+				{
+					const Complex* pRow = plane + (size_t)i * cols + col0;
+					for (int j = 0; j < nCols; j++)
+						columns[(size_t)j * rows + i] = pRow[j];
+				}
+				for (int j = 0; j < nCols; j++)
+					m_colFft.transform(columns.data() + (size_t)j * rows, bInverse, m_scratch[thread]);
+				for (int i = 0; i < rows; i++)
+				{
+					Complex* pRow = plane + (size_t)i * cols + col0;
+					for (int j = 0; j < nCols; j++)
+						pRow[j] = columns[(size_t)j * rows + i];
+				}
+			}
+		});
+	}
+	// End of Fft2 implementation
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+#include <complex>
+
+namespace nzg
+{
+	typedef std::complex<double> Complex;
+
+	////////////////////////////////////////////////////////////////////////////////
+	// Fft - discrete Fourier transform of one length, X[k] = sum x[j] exp(-2 pi i jk/n).
+	// Lengths made of the factors 2..13 go through mixed radix butterflies (radix 2 to 5
+	// specialised, the rest generic); any other length is done by Bluestein's
+	// chirp z-transform over a power of two. The inverse is not divided by n.
+	class Fft
+	{
+	// Construction:
+	public:
+		explicit Fft(int n = 0);
+		void setSize(int n);
+
+	// Attributes:
+	public:
+		int getSize() const { return m_n; }
+
+	// Operations:
+	public:
+		// In place transform of n values; scratch is resized as needed and may be kept
+		// per thread between calls
+		void transform(Complex* data, bool bInverse, std::vector<Complex>& scratch) const;
+
+	// Implementation:
+	protected:
+		enum { c_maxRadix = 13 };
+		int m_n;
+		std::vector<int> m_factors;		// Pairs of radix p and the length m left after it
+		std::vector<Complex> m_twiddles;	// exp(-2 pi i k/n)
+
+		// Bluestein, for lengths with a factor above c_maxRadix
+		std::unique_ptr<Fft> m_pChirpFft;	// Power of two at least 2n-1
+		std::vector<Complex> m_chirp;		// exp(-pi i k^2/n)
+		std::vector<Complex> m_chirpSpectrum; // Transform of the conjugate chirp, wrapped
+
+		size_t getScratchSize() const;
+		void forward(Complex* data, Complex* scratch) const;
+		void work(Complex* out, const Complex* in, size_t stride, const int* factors) const;
+		void butterfly2(Complex* out, size_t stride, int m) const;
+		void butterfly3(Complex* out, size_t stride, int m) const;
+		void butterfly4(Complex* out, size_t stride, int m) const;
+		void butterfly5(Complex* out, size_t stride, int m) const;
+		void butterfly(Complex* out, size_t stride, int m, int p) const;
+	};
+	// End of Fft
+	////////////////////////////////////////////////////////////////////////////////
+
+	////////////////////////////////////////////////////////////////////////////////
+	// Fft2 - 2D transform of a row major rows x cols plane: the rows, then the columns
+	// gathered a few at a time into contiguous buffers, both in parallel on the pool.
+	class Fft2
+	{
+	// Construction:
+	public:
+		Fft2();
+		void setSize(int rows, int cols);
+
+	// Attributes:
+	public:
+		int getRows() const { return m_colFft.getSize(); }
+		int getCols() const { return m_rowFft.getSize(); }
+
+	// Operations:
+	public:
+		void transform(Complex* plane, bool bInverse, ThreadPool& pool);
+
+	// Implementation:
+	protected:
+		enum { c_colBlock = 8 }; // Columns gathered at once, 128 bytes of a row
+		Fft m_rowFft;
+		Fft m_colFft;
+		std::vector<std::vector<Complex>> m_scratch; // Per thread
+		std::vector<std::vector<Complex>> m_columns; // Per thread
+	};
+	// End of Fft2
+	////////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,409 @@
+#include "pch.h"
+
+#include "FrameWriter.h"
+
+namespace nzg
+{
+	namespace
+	{
+		// CRC-32 of PNG chunks, 8 bytes a step (slicing by 8)
+		struct CrcTable
+		{
+			uint32_t t[8][256];
+
+			CrcTable() {
+				for (uint32_t i = 0; i < 256; i++)
+				{
+					uint32_t c = i;
+					for (int k = 0; k < 8; k++)
+						c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+					t[0][i] = c;
+				}
+				for (uint32_t i = 0; i < 256; i++)
+				{
+					for (int k = 1; k < 8; k++)
+						t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
+				}
+			}
+
+			uint32_t update(uint32_t crc, const uint8_t* p, size_t n) const {
+				crc = ~crc;
+				for (; n >= 8; n -= 8, p += 8)
+				{
+					uint32_t lo, hi;
+					memcpy(&lo, p, 4);
+					memcpy(&hi, p + 4, 4);
+					lo ^= crc;
+					crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+						t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+				}
+				for (; n > 0; n--, p++)
+					crc = t[0][(crc ^ *p) & 0xFF] ^ (crc >> 8);
+				return ~crc;
+			}
+		};
+		const CrcTable c_crc;
+
+		void putBE(std::vector<uint8_t>& out, uint32_t v)
+		{
+			uint8_t b[4] = { (uint8_t)(v >> 24), (uint8_t)(v >> 16), (uint8_t)(v >> 8), (uint8_t)v };
+			out.insert(out.end(), b, b + 4);
+		}
+
+		// Writes a PNG stream: chunks of their type and data, the image data as a zlib
+		// stream of stored deflate blocks split over IDAT chunks of about 1 MB
+		class PngStream
+		{
+		public:
+			PngStream(std::ostream& f) : m_f(f), m_a(1), m_b(0), m_nBlock(0), m_posBlock(0) {
+				static const uint8_t sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+				m_f.write((const char*)sig, sizeof(sig));
+			}
+
+			void chunk(const char* type, const uint8_t* p, size_t n) {
+				std::vector<uint8_t> head;
+				putBE(head, (uint32_t)n);
+				head.insert(head.end(), type, type + 4);
+				uint32_t crc = c_crc.update(0, head.data() + 4, 4);
+				crc = c_crc.update(crc, p, n);
+				m_f.write((const char*)head.data(), head.size());
+				m_f.write((const char*)p, n);
+				std::vector<uint8_t> tail;
+				putBE(tail, crc);
+				m_f.write((const char*)tail.data(), tail.size());
+			}
+
+			void beginData() {
+				m_data.reserve(c_chunk + c_block + 16);
+				m_data.push_back(0x78);	// Deflate, 32K window
+				m_data.push_back(0x01);	// No dictionary, fastest, check bits
+			}
+
+			void add(const uint8_t* p, size_t n) {
+				adler(p, n);
+				while (n > 0)
+				{
+					if (m_nBlock == c_block)
+						endBlock(false);
+					if (m_nBlock == 0)
+					{
+						m_posBlock = m_data.size();
+						m_data.resize(m_data.size() + 5);
+					}
+					size_t k = std::min(n, (size_t)(c_block - m_nBlock));
+					m_data.insert(m_data.end(), p, p + k);
+					m_nBlock += (int)k;
+					p += k;
+					n -= k;
+				}
+			}
+
+			void endData() {
+				if (m_nBlock == 0)
+				{
+					m_posBlock = m_data.size();
+					m_data.resize(m_data.size() + 5);
+				}
+				endBlock(true);
+				putBE(m_data, (m_b << 16) | m_a);
+				flush();
+				chunk("IEND", nullptr, 0);
+			}
+
+		protected:
+			enum { c_block = 65535, c_chunk = 1 << 20 };
+			std::ostream& m_f;
+			std::vector<uint8_t> m_data; // Deflate bytes of the next IDAT chunk
+			uint32_t m_a;
+			uint32_t m_b;
+			int m_nBlock;		// Bytes in the open stored block
+			size_t m_posBlock;	// Its header in m_data
+
+			void endBlock(bool bFinal) {
+				uint8_t* h = m_data.data() + m_posBlock;
+				h[0] = bFinal ? 1 : 0;
+				h[1] = (uint8_t)m_nBlock;
+				h[2] = (uint8_t)(m_nBlock >> 8);
+				h[3] = (uint8_t)~m_nBlock;
+				h[4] = (uint8_t)(~m_nBlock >> 8);
+				m_nBlock = 0;
+				if (!bFinal && m_data.size() >= c_chunk)
+					flush();
+			}
+
+			void flush() {
+				chunk("IDAT", m_data.data(), m_data.size());
+				m_data.clear();
+			}
+
+			// Adler-32 with the modulo taken every 5552 bytes, before b can overflow
+			void adler(const uint8_t* p, size_t n) {
+				while (n > 0)
+				{
+					size_t k = std::min(n, (size_t)5552);
+					n -= k;
+					// b gains 8a plus the bytes weighted 8..1 per 8 bytes
+					for (; k >= 8; k -= 8, p += 8)
+					{
+						m_b += 8 * m_a + 8 * p[0] + 7 * p[1] + 6 * p[2] + 5 * p[3] + 4 * p[4] + 3 * p[5] + 2 * p[6] + p[7];
+						m_a += p[0] + p[1] + p[2] + p[3] + p[4] + p[5] + p[6] + p[7];
+					}
+					for (; k > 0; k--)
+					{
+						m_a += *p++;
+						m_b += m_a;
+					}
+					m_a %= 65521;
+					m_b %= 65521;
+				}
+			}
+		};
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	// FrameWriter implementation
+	const char* FrameWriter::c_formats[(int)Format::maxFormat] = { "ppm", "png" };
+
+	std::string FrameWriter::getPath(const std::string& pattern, int64_t generation)
+	{
+		std::string path;
+		bool bDone = false;
+		for (size_t i = 0; i < pattern.size(); i++)
+		{
+			if (pattern[i] != '%' || i + 1 == pattern.size())
+			{
+				path += pattern[i];
+				continue;
+			}
+			if (pattern[i + 1] == '%')
+			{
+				path += '%';
+				i++;
+				continue;
+			}
+
+			size_t j = i + 1;
+			bool bLeft = false;
+			bool bZero = false;
+			for (; j < pattern.size() && (pattern[j] == '-' || pattern[j] == '0'); j++)
+				(pattern[j] == '-' ? bLeft : bZero) = true;
+			size_t nWidth = 0;
+			for (; j < pattern.size() && isdigit((unsigned char)pattern[j]) && nWidth < 64; j++)
+				nWidth = nWidth * 10 + (pattern[j] - '0');
+			if (pattern.compare(j, 3, "I64") == 0)
+				j += 3;
+			else
+				for (int nLongs = 0; nLongs < 2 && j < pattern.size() && pattern[j] == 'l'; nLongs++)
+					j++;
+			if (bDone || j >= pattern.size() || strchr("diu", pattern[j]) == nullptr)
+			{
+				path += pattern[i];
+				continue;
+			}
+
+			std::string digits = std::to_string(generation < 0 ? -generation : generation);
+			std::string sign = generation < 0 ? "-" : "";
+			size_t nPad = nWidth > sign.size() + digits.size() ? nWidth - sign.size() - digits.size() : 0;
+			if (bLeft)
+				path += sign + digits + std::string(nPad, ' ');
+			else if (bZero)
+				path += sign + std::string(nPad, '0') + digits;
+			else
+				path += std::string(nPad, ' ') + sign + digits;
+			bDone = true;
+			i = j;
+		}
+		return path;
+	}
+
+	FrameWriter::FrameWriter() : format(Format::png), block(1), pattern("frame%06lld.png"), tables(false), m_nWritten(0), m_nFailed(0)
+	{
+		m_free.reset(c_jobs);
+		m_queued.reset(c_jobs + 1);
+		for (Job& job : m_jobs)
+			m_free.push(&job);
+	}
+
+	FrameWriter::~FrameWriter()
+	{
+		if (m_thread.joinable())
+		{
+			m_queued.push(nullptr);
+			m_thread.join();
+		}
+	}
+
+	void FrameWriter::write(const GenView& view)
+	{
+		NZG_PROF_SCOPE("FrameWriter::write");
+		if (!m_thread.joinable())
+			m_thread = std::thread(&FrameWriter::writer, this);
+
+		Job* pJob;
+		m_free.waitPop(pJob);
+		render(view, block, pJob->rgb, pJob->width, pJob->height);
+		pJob->format = format;
+		pJob->path = getPath(pattern, view.generation);
+		pJob->tablePath.clear();
+		if (tables)
+		{
+			m_pool.setThreads(0);
+			pJob->table.build(view, block, m_pool);
+			pJob->tablePath = std::filesystem::path(pJob->path).replace_extension(".sat").string();
+		}
+		m_queued.push(pJob);
+	}
+
+	void FrameWriter::finish()
+	{
+		// All jobs back in the free ring means nothing is queued
+		Job* pJobs[c_jobs];
+		for (Job*& pJob : pJobs)
+			m_free.waitPop(pJob);
+		for (Job* pJob : pJobs)
+			m_free.push(pJob);
+	}
+
+	void FrameWriter::writer()
+	{
+		for (;;)
+		{
+			Job* pJob;
+			m_queued.waitPop(pJob);
+			if (pJob == nullptr)
+				return;
+
+			bool bOk = pJob->format == Format::ppm ? writePpm(pJob->path, pJob->rgb.data(), pJob->width, pJob->height) :
+				writePng(pJob->path, pJob->rgb.data(), pJob->width, pJob->height);
+			if (!pJob->tablePath.empty())
+				bOk &= pJob->table.save(pJob->tablePath);
+			if (bOk)
+				m_nWritten++;
+			else
+				m_nFailed++;
+			m_free.push(pJob);
+		}
+	}
+
+	void FrameWriter::render(const GenView& view, int block, std::vector<uint8_t>& rgb, int& width, int& height)
+	{
+		NZG_PROF_SCOPE("FrameWriter::render");
+		block = std::max(block, 1);
+		width = (view.cols + block - 1) / block;
+		height = (view.rows + block - 1) / block;
+		rgb.resize((size_t)width * height * 3 + 1);
+
+		// Colours as R, G, B, 0 bytes; a pixel is stored as 4 bytes, the next one
+		// overwrites the fourth
+		const std::vector<Strat>& strats = view.strats->getStrats();
+		std::vector<uint32_t> lut(strats.size());
+		for (size_t i = 0; i < lut.size(); i++)
+		{
+			DWORD clr = strats[i].getColor();
+			lut[i] = GetRValue(clr) | (GetGValue(clr) << 8) | (GetBValue(clr) << 16);
+		}
+
+		uint8_t* pOut = rgb.data();
+		if (block == 1)
+		{
+			size_t n = (size_t)view.rows * view.cols;
+			for (size_t i = 0; i < n; i++)
+				memcpy(pOut + 3 * i, &lut[view.types[i]], 4);
+			return;
+		}
+
+		// Block majority: counts by type id, reset through the list of the ids seen
+		std::vector<uint32_t> counts(strats.size(), 0);
+		std::vector<TypeId> seen;
+		seen.reserve((size_t)block * block);
+		for (int by = 0; by < height; by++)
+		{
+			int row1 = std::min((by + 1) * block, view.rows);
+			for (int bx = 0; bx < width; bx++)
+			{
+				int col0 = bx * block;
+				int col1 = std::min(col0 + block, view.cols);
+				// Most blocks of a clustered map hold one type
+				TypeId first = view.types[(size_t)by * block * view.cols + col0];
+				bool bUniform = true;
+				for (int row = by * block; row < row1 && bUniform; row++)
+				{
+					const TypeId* pTypes = view.types + (size_t)row * view.cols;
+					for (int col = col0; col < col1; col++)
+						bUniform &= pTypes[col] == first;
+				}
+				if (bUniform)
+				{
+					memcpy(pOut, &lut[first], 4);
+					pOut += 3;
+					continue;
+				}
+
+				for (int row = by * block; row < row1; row++)
+				{
+					const TypeId* pTypes = view.types + (size_t)row * view.cols;
+					for (int col = col0; col < col1; col++)
+					{
+						if (counts[pTypes[col]]++ == 0)
+							seen.push_back(pTypes[col]);
+					}
+				}
+
+				TypeId best = seen[0];
+				for (TypeId id : seen)
+				{
+					if (counts[id] > counts[best])
+						best = id;
+				}
+				for (TypeId id : seen)
+					counts[id] = 0;
+				seen.clear();
+
+				memcpy(pOut, &lut[best], 4);
+				pOut += 3;
+			}
+		}
+	}
+
+	bool FrameWriter::writePpm(const std::string& path, const uint8_t* rgb, int width, int height)
+	{
+		NZG_PROF_SCOPE("FrameWriter::writePpm");
+		std::ofstream f(std::filesystem::path(path), std::ios::binary | std::ios::trunc);
+		if (!f)
+			return false;
+		f << "P6\n" << width << " " << height << "\n255\n";
+		f.write((const char*)rgb, (std::streamsize)width * height * 3);
+		return (bool)f;
+	}
+
+	bool FrameWriter::writePng(const std::string& path, const uint8_t* rgb, int width, int height)
+	{
+		NZG_PROF_SCOPE("FrameWriter::writePng");
+		std::ofstream f(std::filesystem::path(path), std::ios::binary | std::ios::trunc);
+		if (!f)
+			return false;
+
+		PngStream png(f);
+		std::vector<uint8_t> ihdr;
+		putBE(ihdr, width);
+		putBE(ihdr, height);
+		ihdr.push_back(8);	// Bits per channel
+		ihdr.push_back(2);	// Truecolour
+		ihdr.push_back(0);	// Deflate
+		ihdr.push_back(0);	// Adaptive filtering
+		ihdr.push_back(0);	// Not interlaced
+		png.chunk("IHDR", ihdr.data(), ihdr.size());
+
+		png.beginData();
+		const uint8_t filter = 0;
+		for (int y = 0; y < height; y++)
+		{
+			png.add(&filter, 1);
+			png.add(rgb + (size_t)y * width * 3, (size_t)width * 3);
+		}
+		png.endData();
+		return (bool)f;
+	}
+	// End of FrameWriter implementation
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+}
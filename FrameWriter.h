@@ -0,0 +1,88 @@
+#pragma once
+
+#include "NzgNode.h"
+#include "SpscQueue.h"
+#include "SummedArea.h"
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////
+	// FrameWriter - one image file per generation, for movies of a run. The caller's
+	// thread maps the type plane through the colours of the types into an RGB buffer,
+	// a background thread encodes and writes it. Big maps can be shrunk by blocks of
+	// block x block cells, each showing the type most of its cells hold. With tables
+	// on, the summed-area tables of the generation (on the lines of the blocks) go
+	// next to each image, as a .sat file of the same name.
+	class FrameWriter
+	{
+	// Construction:
+	public:
+		FrameWriter();
+		~FrameWriter();
+		FrameWriter(const FrameWriter&) = delete;
+		FrameWriter& operator=(const FrameWriter&) = delete;
+
+		enum class Format
+		{
+			ppm = 0,	// Binary P6
+			png = 1,	// Stored (uncompressed) deflate, nothing to compress for
+			maxFormat
+		};
+		static const char* c_formats[(int)Format::maxFormat];
+
+	// Attributes:
+	public:
+		Format format;
+		int block;			// Cells per pixel along either side, 1 for full size
+		std::string pattern; // File names, the generation goes for a %d (%06lld, ...), see getPath
+		bool tables;		// Also save a SummedArea per frame
+
+		int64_t getWritten() const { return m_nWritten; }
+		int64_t getFailed() const { return m_nFailed; }
+
+	// Operations:
+	public:
+		// Renders the view and queues it for writing; waits while all buffers are queued
+		void write(const GenView& view);
+		// Waits until the queued frames are written
+		void finish();
+
+		// The pattern with its first integer conversion (% with flags 0 or -, a width and
+		// the size prefixes l, ll or I64, then d, i or u) replaced by the generation and %%
+		// by %. Any other text is taken as it is, the pattern is no printf format.
+		static std::string getPath(const std::string& pattern, int64_t generation);
+
+		// Image encoders, rgb holds height rows of 3 * width bytes
+		static bool writePpm(const std::string& path, const uint8_t* rgb, int width, int height);
+		static bool writePng(const std::string& path, const uint8_t* rgb, int width, int height);
+
+		// RGB of the view, shrunk by blocks; rgb gets one byte of slack past the image
+		static void render(const GenView& view, int block, std::vector<uint8_t>& rgb, int& width, int& height);
+
+	// Implementation:
+	protected:
+		struct Job
+		{
+			std::vector<uint8_t> rgb;
+			int width;
+			int height;
+			Format format;
+			std::string path;
+			SummedArea table;
+			std::string tablePath;	// Empty for no table
+		};
+		enum { c_jobs = 3 };
+
+		Job m_jobs[c_jobs];
+		SpscQueue<Job*> m_free;		// Writer -> caller
+		SpscQueue<Job*> m_queued;	// Caller -> writer, nullptr stops the writer
+		std::thread m_thread;
+		std::atomic<int64_t> m_nWritten;
+		std::atomic<int64_t> m_nFailed;
+		ThreadPool m_pool;			// Table builds
+
+		void writer();
+	};
+	// End of FrameWriter
+	////////////////////////////////////////////////////////////////////////////////
+}
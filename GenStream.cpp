@@ -0,0 +1,62 @@
+#include "pch.h"
+
+#include "GenStream.h"
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	// GenStream implementation
+	GenStream::GenStream(NzgNode& node) : m_node(node), m_nNextId(1)
+	{
+	}
+
+	int GenStream::subscribe(int every, Callback callback)
+	{
+		Subscriber sub;
+		sub.id = m_nNextId++;
+		sub.every = std::max(every, 1);
+		sub.next = m_node.getGeneration() + sub.every;
+		sub.callback = std::move(callback);
+		m_subs.push_back(std::move(sub));
+		return m_subs.back().id;
+	}
+
+	void GenStream::unsubscribe(int id)
+	{
+		m_subs.erase(std::remove_if(m_subs.begin(), m_subs.end(), [id](const Subscriber& sub) {
+			return sub.id == id;
+		}), m_subs.end());
+	}
+
+	void GenStream::run(int64_t nGenerations)
+	{
+		int64_t end = m_node.getGeneration() + nGenerations;
+		while (m_node.getGeneration() < end)
+		{
+			// Straight to the next generation anybody wants
+			int64_t next = end;
+			for (const Subscriber& sub : m_subs)
+				next = std::min(next, sub.next);
+			m_node.run((int)std::min<int64_t>(next - m_node.getGeneration(), INT_MAX));
+			m_node.updateScores();
+
+			GenView view = m_node.getView();
+			for (size_t i = 0; i < m_subs.size(); )
+			{
+				Subscriber& sub = m_subs[i];
+				if (sub.next != view.generation)
+				{
+					i++;
+					continue;
+				}
+				sub.next += sub.every;
+				if (sub.callback(view))
+					i++;
+				else
+					m_subs.erase(m_subs.begin() + i);
+			}
+		}
+	}
+	// End of GenStream implementation
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "NzgNode.h"
+
+#include <functional>
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////
+	// GenStream - hands the generations of a node to subscribers that each want every
+	// k-th one. The callbacks run on the thread of run() before the engine moves on,
+	// so a slow consumer holds the engine back instead of losing frames, and the
+	// engine steps straight over the generations nobody wants.
+	class GenStream
+	{
+	// Construction:
+	public:
+		explicit GenStream(NzgNode& node);
+
+		// Returns false to unsubscribe; it must not subscribe or unsubscribe itself
+		typedef std::function<bool(const GenView&)> Callback;
+
+	// Attributes:
+	public:
+		size_t getSubscribers() const { return m_subs.size(); }
+
+	// Operations:
+	public:
+		// Delivery every every-th generation, counted from the generation of the node now
+		int subscribe(int every, Callback callback);
+		void unsubscribe(int id);
+		// Runs nGenerations generations, delivering the views on the way
+		void run(int64_t nGenerations);
+
+	// Implementation:
+	protected:
+		struct Subscriber
+		{
+			int id;
+			int every;
+			int64_t next;	// Generation of the next delivery
+			Callback callback;
+		};
+		NzgNode& m_node;
+		std::vector<Subscriber> m_subs;
+		int m_nNextId;
+	};
+	// End of GenStream
+	////////////////////////////////////////////////////////////////////////////////
+}
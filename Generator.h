@@ -0,0 +1,104 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////
+	// Generator - lazy sequence of the values a coroutine co_yields (std::generator
+	// comes only with C++23). The coroutine runs only while the consumer asks for the
+	// next value, and a yielded value lives until then:
+	//
+	//   for (const GenView& view : node.generations(10))
+	//       draw(view);
+	//
+	template<class T>
+	class Generator
+	{
+	public:
+		struct promise_type
+		{
+			const T* pValue = nullptr;
+			std::exception_ptr exception;
+
+			Generator get_return_object() {
+				return Generator(std::coroutine_handle<promise_type>::from_promise(*this));
+			}
+			std::suspend_always initial_suspend() noexcept { return {}; }
+			std::suspend_always final_suspend() noexcept { return {}; }
+			std::suspend_always yield_value(const T& value) noexcept {
+				pValue = std::addressof(value);
+				return {};
+			}
+			void return_void() {}
+			void unhandled_exception() { exception = std::current_exception(); }
+		};
+		typedef std::coroutine_handle<promise_type> Handle;
+
+		class iterator
+		{
+		public:
+			iterator() : m_h(nullptr) {}
+			explicit iterator(Handle h) : m_h(h) {}
+
+			const T& operator*() const { return *m_h.promise().pValue; }
+			const T* operator->() const { return m_h.promise().pValue; }
+			iterator& operator++() {
+				resume(m_h);
+				return *this;
+			}
+			bool operator==(std::default_sentinel_t) const { return !m_h || m_h.done(); }
+			bool operator!=(std::default_sentinel_t s) const { return !(*this == s); }
+
+		protected:
+			Handle m_h;
+		};
+
+	// Construction:
+	public:
+		explicit Generator(Handle h) : m_h(h) {}
+		Generator(Generator&& other) noexcept : m_h(other.m_h) {
+			other.m_h = nullptr;
+		}
+		Generator& operator=(Generator&& other) noexcept {
+			if (this != &other)
+			{
+				if (m_h)
+					m_h.destroy();
+				m_h = other.m_h;
+				other.m_h = nullptr;
+			}
+			return *this;
+		}
+		Generator(const Generator&) = delete;
+		Generator& operator=(const Generator&) = delete;
+		~Generator() {
+			if (m_h)
+				m_h.destroy();
+		}
+
+	// Operations:
+	public:
+		iterator begin() {
+			resume(m_h);
+			return iterator(m_h);
+		}
+		std::default_sentinel_t end() { return std::default_sentinel; }
+
+	// Implementation:
+	protected:
+		Handle m_h;
+
+		// Runs the coroutine to its next co_yield, passing on what it threw
+		static void resume(Handle h) {
+			if (!h || h.done())
+				return;
+			h.resume();
+			if (h.promise().exception)
+				std::rethrow_exception(h.promise().exception);
+		}
+	};
+	// End of Generator
+	////////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,417 @@
+#include "pch.h"
+
+#include "MapGen.h"
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	// MapGen implementation
+	const char* MapGen::c_patterns[(int)Pattern::maxPattern] = {
+		"uniform",
+		"voronoi",
+		"stripes",
+		"invader",
+		"bitmap"
+	};
+
+	MapGen::MapGen(Pattern p) : pattern(p), seed(1), sites(256), stripeWidth(0), vertical(false), invaderSize(1),
+		m_bmpRows(0), m_bmpCols(0)
+	{
+		types = {
+			(TypeId)Strat::Type::yes, (TypeId)Strat::Type::no, (TypeId)Strat::Type::friedman, (TypeId)Strat::Type::joss,
+			(TypeId)Strat::Type::graaskamp, (TypeId)Strat::Type::titfortat, (TypeId)Strat::Type::random
+		};
+	}
+
+	MapGen::~MapGen()
+	{
+	}
+
+	void MapGen::generate(StratMatrix& sts, ThreadPool& pool) const
+	{
+		NZG_PROF_SCOPE("MapGen::generate");
+		if (types.empty() || sts.getSize() == 0)
+			return;
+
+		switch (pattern)
+		{
+		case Pattern::voronoi:
+			generateVoronoi(sts, pool);
+			break;
+		case Pattern::stripes:
+			generateStripes(sts, pool);
+			break;
+		case Pattern::invader:
+			generateInvader(sts, pool);
+			break;
+		case Pattern::bitmap:
+			generateBitmap(sts, pool);
+			break;
+		default:
+			generateUniform(sts, pool);
+			break;
+		}
+	}
+
+	// Cumulative shares in units of 2^-32, the last one 2^32
+	std::vector<uint64_t> MapGen::getThresholds() const
+	{
+		std::vector<double> w(types.size(), 1.0);
+		for (size_t k = 0; k < w.size() && k < shares.size(); k++)
+			w[k] = std::max(shares[k], 0.0);
+		double total = 0;
+		for (double x : w)
+			total += x;
+		if (total <= 0)
+		{
+			w.assign(types.size(), 1.0);
+			total = (double)w.size();
+		}
+
+		std::vector<uint64_t> thresholds(w.size());
+		double sum = 0;
+		for (size_t k = 0; k < w.size(); k++)
+		{
+			sum += w[k];
+			thresholds[k] = (uint64_t)std::llround(sum / total * 4294967296.0);
+		}
+		thresholds.back() = 4294967296ull;
+		return thresholds;
+	}
+
+	TypeId MapGen::draw(const std::vector<uint64_t>& thresholds, uint32_t u) const
+	{
+		size_t k = 0;
+		while (u >= thresholds[k])
+			k++;
+		return types[k];
+	}
+
+	Rng MapGen::getRowRng(int row) const
+	{
+		return Rng(seed + (uint64_t)(row + 1) * 0xD1B54A32D192ED03ull);
+	}
+
+	void MapGen::generateUniform(StratMatrix& sts, ThreadPool& pool) const
+	{
+		std::vector<uint64_t> thresholds = getThresholds();
+		int cols = sts.getCols();
+		pool.parallelFor(sts.getRows(), [&](int row0, int row1, int) {
+			for (int i = row0; i < row1; i++)
+			{
+				Rng rng = getRowRng(i);
+				TypeId* pRow = sts.getTypeRow(i);
+				int j = 0;
+				for (; j + 1 < cols; j += 2)
+				{
+					uint64_t r = rng.next();
+					pRow[j] = draw(thresholds, (uint32_t)(r >> 32));
+					pRow[j + 1] = draw(thresholds, (uint32_t)r);
+				}
+				if (j < cols)
+					pRow[j] = draw(thresholds, (uint32_t)(rng.next() >> 32));
+			}
+		});
+	}
+
+	// Every cell takes the type of the nearest site on the torus, the first one on a tie.
+	// The sites are bucketed on a coarse grid. For every bucket the candidates are the
+	// sites that are no farther from it than some site is from its farthest cell; they
+	// are found by rings of buckets around it, and its cells only look at them.
+	void MapGen::generateVoronoi(StratMatrix& sts, ThreadPool& pool) const
+	{
+		int rows = sts.getRows();
+		int cols = sts.getCols();
+		int nSites = (int)std::max<int64_t>(1, std::min<int64_t>(sites, sts.getSize()));
+
+		std::vector<uint64_t> thresholds = getThresholds();
+		Rng rng(seed);
+		std::vector<Site> all(nSites);
+		for (auto& s : all)
+		{
+			s.row = (int)rng.below((uint32_t)rows);
+			s.col = (int)rng.below((uint32_t)cols);
+			s.type = draw(thresholds, (uint32_t)(rng.next() >> 32));
+		}
+
+		int nbRows = std::min(rows, std::max(1, (int)std::sqrt((double)nSites * rows / cols)));
+		int nbCols = std::min(cols, std::max(1, nSites / nbRows));
+
+		// First row of bucket row b, for b beyond the grid too
+		auto edge = [](int64_t b, int64_t n, int64_t nb) {
+			int64_t x = b * n;
+			return x >= 0 ? (x + nb - 1) / nb : -(-x / nb);
+		};
+
+		// Sites by bucket, bucket b holding bucketSites[bucketStart[b]..bucketStart[b + 1])
+		std::vector<int> bucketStart(nbRows * nbCols + 1, 0);
+		std::vector<int> bucketSites(nSites);
+		auto bucketOf = [&](int row, int col) {
+			return (int)((int64_t)row * nbRows / rows) * nbCols + (int)((int64_t)col * nbCols / cols);
+		};
+		for (const auto& s : all)
+			bucketStart[bucketOf(s.row, s.col) + 1]++;
+		for (int b = 0; b < nbRows * nbCols; b++)
+			bucketStart[b + 1] += bucketStart[b];
+		std::vector<int> fill(bucketStart.begin(), bucketStart.end() - 1);
+		for (int k = 0; k < nSites; k++)
+			bucketSites[fill[bucketOf(all[k].row, all[k].col)]++] = k;
+
+		// Nearest and farthest distance on a circle of n from x to the cells [a, b]
+		auto span = [](int64_t x, int64_t a, int64_t b, int64_t n, int64_t& dMin, int64_t& dMax) {
+			auto wrap = [n](int64_t d) {
+				d = std::abs(d) % n;
+				return std::min(d, n - d);
+			};
+			dMin = (x >= a && x <= b) ? 0 : std::min(wrap(x - a), wrap(x - b));
+			int64_t anti = (x + n / 2) % n;
+			dMax = (anti >= a && anti <= b) ? n / 2 : std::max(wrap(x - a), wrap(x - b));
+		};
+
+		std::vector<std::vector<int>> candidates(nbRows * nbCols);
+		pool.parallelFor(nbRows, [&](int brow0, int brow1, int) {
+			std::vector<std::pair<int64_t, int>> found;
+			for (int bi = brow0; bi < brow1; bi++)
+			{
+				int64_t r0 = edge(bi, rows, nbRows);
+				int64_t r1 = edge(bi + 1, rows, nbRows) - 1;
+				for (int bj = 0; bj < nbCols; bj++)
+				{
+					int64_t c0 = edge(bj, cols, nbCols);
+					int64_t c1 = edge(bj + 1, cols, nbCols) - 1;
+					int64_t reach = INT64_MAX; // Squared distance some site has to every cell
+					found.clear();
+
+					for (int ring = 0;; ring++)
+					{
+						bool bAll = 2 * ring + 1 >= nbRows && 2 * ring + 1 >= nbCols;
+						for (int di = -ring; di <= ring; di++)
+						{
+							int b = (bi + di % nbRows + nbRows) % nbRows * nbCols;
+							// Inner rows of the ring hold only its two side buckets
+							int step = std::abs(di) == ring ? 1 : 2 * ring;
+							for (int dj = -ring; dj <= ring; dj += step)
+							{
+								int bb = b + (bj + dj % nbCols + nbCols) % nbCols;
+								for (int n = bucketStart[bb]; n < bucketStart[bb + 1]; n++)
+								{
+									const Site& s = all[bucketSites[n]];
+									int64_t drMin, drMax, dcMin, dcMax;
+									span(s.row, r0, r1, rows, drMin, drMax);
+									span(s.col, c0, c1, cols, dcMin, dcMax);
+									reach = std::min(reach, drMax * drMax + dcMax * dcMax);
+									found.push_back(std::make_pair(drMin * drMin + dcMin * dcMin, bucketSites[n]));
+								}
+							}
+						}
+						if (bAll)
+							break;
+
+						// Unsearched buckets lie beyond the edges of the searched square
+						// in a dimension it does not cover entirely
+						int64_t bound = INT64_MAX;
+						if (2 * ring + 1 < nbRows)
+							bound = std::min(r0 - edge(bi - ring, rows, nbRows) + 1, edge(bi + ring + 1, rows, nbRows) - r1);
+						if (2 * ring + 1 < nbCols)
+							bound = std::min(bound, std::min(c0 - edge(bj - ring, cols, nbCols) + 1, edge(bj + ring + 1, cols, nbCols) - c1));
+						if (reach < bound * bound)
+							break;
+					}
+
+					std::vector<int>& cands = candidates[bi * nbCols + bj];
+					for (const auto& f : found)
+					{
+						if (f.first <= reach)
+							cands.push_back(f.second);
+					}
+					// Rings wrapping round a small grid meet some buckets twice
+					std::sort(cands.begin(), cands.end());
+					cands.erase(std::unique(cands.begin(), cands.end()), cands.end());
+				}
+			}
+		});
+
+		pool.parallelFor(rows, [&](int row0, int row1, int) {
+			for (int i = row0; i < row1; i++)
+			{
+				TypeId* pRow = sts.getTypeRow(i);
+				int bi = (int)((int64_t)i * nbRows / rows);
+				for (int bj = 0; bj < nbCols; bj++)
+				{
+					const std::vector<int>& cands = candidates[bi * nbCols + bj];
+					int c1 = (int)edge(bj + 1, cols, nbCols);
+					for (int j = (int)edge(bj, cols, nbCols); j < c1; j++)
+					{
+						// Candidates are in site order, so the first nearest one wins
+						int64_t best = INT64_MAX;
+						int nBest = cands[0];
+						for (int k : cands)
+						{
+							const Site& s = all[k];
+							int dr = std::abs(i - s.row);
+							int dc = std::abs(j - s.col);
+							dr = std::min(dr, rows - dr);
+							dc = std::min(dc, cols - dc);
+							int64_t d = (int64_t)dr * dr + (int64_t)dc * dc;
+							if (d < best)
+							{
+								best = d;
+								nBest = k;
+							}
+						}
+						pRow[j] = all[nBest].type;
+					}
+				}
+			}
+		});
+	}
+
+	// Repeating stripes of stripeWidth cycling through the types, or one stripe per
+	// type as wide as its share
+	void MapGen::generateStripes(StratMatrix& sts, ThreadPool& pool) const
+	{
+		int extent = vertical ? sts.getCols() : sts.getRows();
+		std::vector<TypeId> byPos(extent);
+		if (stripeWidth > 0)
+		{
+			for (int p = 0; p < extent; p++)
+				byPos[p] = types[(p / stripeWidth) % types.size()];
+		}
+		else
+		{
+			std::vector<uint64_t> thresholds = getThresholds();
+			for (int p = 0; p < extent; p++)
+				byPos[p] = draw(thresholds, (uint32_t)(((uint64_t)p << 32) / extent));
+		}
+
+		int cols = sts.getCols();
+		pool.parallelFor(sts.getRows(), [&](int row0, int row1, int) {
+			for (int i = row0; i < row1; i++)
+			{
+				TypeId* pRow = sts.getTypeRow(i);
+				if (vertical)
+					std::copy(byPos.begin(), byPos.end(), pRow);
+				else
+					std::fill(pRow, pRow + cols, byPos[i]);
+			}
+		});
+	}
+
+	void MapGen::generateInvader(StratMatrix& sts, ThreadPool& pool) const
+	{
+		TypeId resident = types[0];
+		TypeId invader = types.size() > 1 ? types[1] : types[0];
+		int size = std::max(1, invaderSize);
+		int r0 = (sts.getRows() - size) / 2;
+		int c0 = std::max(0, (sts.getCols() - size) / 2);
+		int c1 = std::min(sts.getCols(), c0 + size);
+
+		int cols = sts.getCols();
+		pool.parallelFor(sts.getRows(), [&](int row0, int row1, int) {
+			for (int i = row0; i < row1; i++)
+			{
+				TypeId* pRow = sts.getTypeRow(i);
+				std::fill(pRow, pRow + cols, resident);
+				if (i >= r0 && i < r0 + size)
+					std::fill(pRow + c0, pRow + c1, invader);
+			}
+		});
+	}
+
+	// Nearest neighbour scaling of the bitmap to the grid
+	void MapGen::generateBitmap(StratMatrix& sts, ThreadPool& pool) const
+	{
+		if (m_bitmap.empty())
+		{
+			generateUniform(sts, pool);
+			return;
+		}
+
+		int rows = sts.getRows();
+		int cols = sts.getCols();
+		std::vector<int> srcCol(cols);
+		for (int j = 0; j < cols; j++)
+			srcCol[j] = (int)((int64_t)j * m_bmpCols / cols);
+
+		pool.parallelFor(rows, [&](int row0, int row1, int) {
+			for (int i = row0; i < row1; i++)
+			{
+				const TypeId* pSrc = m_bitmap.data() + (size_t)((int64_t)i * m_bmpRows / rows) * m_bmpCols;
+				TypeId* pRow = sts.getTypeRow(i);
+				for (int j = 0; j < cols; j++)
+					pRow[j] = pSrc[srcCol[j]];
+			}
+		});
+	}
+
+	bool MapGen::loadBitmap(const std::string& path)
+	{
+		std::ifstream ifs(path, std::ios::binary);
+		if (!ifs || types.empty())
+			return false;
+		std::vector<uint8_t> data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+
+		// BITMAPFILEHEADER and BITMAPINFOHEADER, little endian
+		auto u16 = [&](size_t pos) { return (uint32_t)data[pos] | ((uint32_t)data[pos + 1] << 8); };
+		auto u32 = [&](size_t pos) { return u16(pos) | (u16(pos + 2) << 16); };
+		if (data.size() < 54 || data[0] != 'B' || data[1] != 'M')
+			return false;
+		uint32_t offset = u32(10);
+		int width = (int)u32(18);
+		int height = (int)u32(22);
+		int bpp = (int)u16(28);
+		uint32_t compression = u32(30);
+		bool bTopDown = height < 0;
+		height = std::abs(height);
+		if (width <= 0 || height == 0 || (bpp != 24 && bpp != 32) || (compression != 0 && compression != 3))
+			return false;
+
+		size_t stride = ((size_t)width * bpp + 31) / 32 * 4;
+		if (offset + stride * height > data.size())
+			return false;
+
+		// Colour to type, the nearest of the type colours in RGB
+		std::vector<DWORD> colors(types.size());
+		for (size_t k = 0; k < types.size(); k++)
+			colors[k] = Strat((Strat::Type)types[k]).getColor();
+		std::unordered_map<uint32_t, TypeId> cache;
+		auto match = [&](int r, int g, int b) {
+			uint32_t key = (uint32_t)r << 16 | (uint32_t)g << 8 | (uint32_t)b;
+			auto it = cache.find(key);
+			if (it != cache.end())
+				return it->second;
+
+			int best = INT_MAX;
+			TypeId id = types[0];
+			for (size_t k = 0; k < colors.size(); k++)
+			{
+				int dr = r - GetRValue(colors[k]);
+				int dg = g - GetGValue(colors[k]);
+				int db = b - GetBValue(colors[k]);
+				int d = dr * dr + dg * dg + db * db;
+				if (d < best)
+				{
+					best = d;
+					id = types[k];
+				}
+			}
+			cache[key] = id;
+			return id;
+		};
+
+		m_bitmap.resize((size_t)width * height);
+		for (int i = 0; i < height; i++)
+		{
+			const uint8_t* pSrc = data.data() + offset + stride * (bTopDown ? i : height - 1 - i);
+			TypeId* pDst = m_bitmap.data() + (size_t)i * width;
+			for (int j = 0; j < width; j++, pSrc += bpp / 8)
+				pDst[j] = match(pSrc[2], pSrc[1], pSrc[0]);
+		}
+		m_bmpRows = height;
+		m_bmpCols = width;
+		pattern = Pattern::bitmap;
+		return true;
+	}
+	// End of MapGen implementation
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "NzgNode.h"
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////
+	// MapGen - initial maps of built-in types, generated by rows in parallel.
+	// Every row draws from its own stream of the seed, so a map does not depend on
+	// the number of threads.
+	class MapGen
+	{
+	// Construction:
+	public:
+		enum class Pattern
+		{
+			uniform = 0,	// Independent cells, types drawn by their shares
+			voronoi = 1,	// Clusters around random sites, site types drawn by their shares
+			stripes = 2,	// Bands of one type each
+			invader = 3,	// A square of types[1] amid types[0]
+			bitmap = 4,		// A loaded picture, colours matched to the type colours
+			maxPattern
+		};
+		static const char* c_patterns[(int)Pattern::maxPattern];
+
+		MapGen(Pattern p = Pattern::uniform);
+		~MapGen();
+
+	// Attributes:
+	public:
+		Pattern pattern;
+		std::vector<TypeId> types;	// Types of the map, the built-in ones by default
+		std::vector<double> shares;	// Relative shares of types, equal when empty
+		uint64_t seed;
+		int sites;			// Voronoi: number of clusters
+		int stripeWidth;	// Stripes: width in cells, 0 for one stripe per type sized by the shares
+		bool vertical;		// Stripes: columns instead of rows
+		int invaderSize;	// Invader: side of the square
+
+		int getBitmapRows() const { return m_bmpRows; }
+		int getBitmapCols() const { return m_bmpCols; }
+
+	// Operations:
+	public:
+		// Uncompressed 24 or 32 bit BMP, each pixel gets the type of the nearest colour.
+		// Sets pattern to bitmap.
+		bool loadBitmap(const std::string& path);
+
+		void generate(StratMatrix& sts, ThreadPool& pool) const;
+
+	// Implementation:
+	protected:
+		struct Site
+		{
+			int row;
+			int col;
+			TypeId type;
+		};
+
+		std::vector<TypeId> m_bitmap; // Types of the loaded pixels, top row first
+		int m_bmpRows;
+		int m_bmpCols;
+
+		std::vector<uint64_t> getThresholds() const;
+		TypeId draw(const std::vector<uint64_t>& thresholds, uint32_t u) const;
+		Rng getRowRng(int row) const;
+
+		void generateUniform(StratMatrix& sts, ThreadPool& pool) const;
+		void generateVoronoi(StratMatrix& sts, ThreadPool& pool) const;
+		void generateStripes(StratMatrix& sts, ThreadPool& pool) const;
+		void generateInvader(StratMatrix& sts, ThreadPool& pool) const;
+		void generateBitmap(StratMatrix& sts, ThreadPool& pool) const;
+	};
+	// End of MapGen
+	////////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,137 @@
+#include "pch.h"
+
+#include "NormalEqs.h"
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	// NormalEqs implementation
+	NormalEqs::NormalEqs() : threads(0)
+	{
+	}
+
+	NormalEqs& NormalEqs::getLocal()
+	{
+		thread_local NormalEqs eqs;
+		return eqs;
+	}
+
+	// The chunks go in waves of one per thread. The sums of a wave join the tree in chunk
+	// order like a binary counter, equal levels merging with the earlier chunks on the
+	// left; the partial sums left at the end are folded from the right. The tree does not
+	// depend on the size of the waves, so a fit of a few chunks starts no more threads
+	// than it has chunks, and the pool only grows
+	void NormalEqs::accumulate(int n, int nObs, const RowFn& fn, Matrix& N, Vector& U)
+	{
+		if (n <= 0 || nObs <= 0)
+			return;
+
+		int nChunks = (nObs + c_chunk - 1) / c_chunk;
+		int nThreads = std::min(threads > 0 ? threads : ThreadPool::getHardwareThreads(), nChunks);
+		if (nThreads > m_pool.getThreads())
+			m_pool.setThreads(nThreads);
+		if ((int)m_scratch.size() < m_pool.getThreads())
+			m_scratch.resize(m_pool.getThreads());
+		std::vector<Sum*> wave(nThreads);
+		std::vector<Sum*> tree;
+		for (int c0 = 0; c0 < nChunks; c0 += nThreads)
+		{
+			int nWave = std::min(nThreads, nChunks - c0);
+			for (int t = 0; t < nWave; t++)
+				wave[t] = getSum(n);
+			m_pool.run(nWave, [&](int task, int thread) {
+				sumChunk(n, nObs, c0 + task, fn, *wave[task], m_scratch[thread]);
+			});
+
+			for (int t = 0; t < nWave; t++)
+			{
+				tree.push_back(wave[t]);
+				while (tree.size() >= 2 && tree[tree.size() - 2]->level == tree.back()->level)
+				{
+					add(n, *tree[tree.size() - 2], *tree.back());
+					tree[tree.size() - 2]->level++;
+					m_spare.push_back(tree.back());
+					tree.pop_back();
+				}
+			}
+		}
+		while (tree.size() >= 2)
+		{
+			add(n, *tree[tree.size() - 2], *tree.back());
+			m_spare.push_back(tree.back());
+			tree.pop_back();
+		}
+
+		const Sum& total = *tree[0];
+		for (int i = 0; i < n; i++)
+		{
+			for (int j = i; j < n; j++)
+				N(i, j) += total.n(i, j);
+		}
+		U.axpy(1.0, total.u.data(), n);
+		m_spare.push_back(tree[0]);
+	}
+
+	void NormalEqs::sumChunk(int n, int nObs, int nChunk, const RowFn& fn, Sum& sum, Scratch& scratch) const
+	{
+		std::vector<double>& batch = scratch.batch;
+		std::vector<double>& weights = scratch.weights;
+		batch.resize((size_t)c_batch * n);
+		weights.resize(c_batch);
+		int nRows = 0;
+		int i1 = std::min((nChunk + 1) * (int)c_chunk, nObs);
+		for (int i = nChunk * c_chunk; i < i1; i++)
+		{
+			double* pRow = batch.data() + (size_t)nRows * n;
+			double value = 0;
+			double weight = 1;
+			if (fn(i, pRow, value, weight))
+			{
+				weights[nRows++] = weight;
+				double a = weight * value;
+				for (int j = 0; j < n; j++)
+					sum.u[j] += a * pRow[j];
+			}
+			if (nRows == c_batch || (i + 1 == i1 && nRows > 0))
+			{
+				sum.n.syrk(1.0, batch.data(), nRows, n, weights.data());
+				nRows = 0;
+			}
+		}
+	}
+
+	void NormalEqs::add(int n, Sum& dst, const Sum& src)
+	{
+		m_pool.parallelFor(n, [&](int i0, int i1, int) {
+			for (int i = i0; i < i1; i++)
+			{
+				for (int j = i; j < n; j++)
+					dst.n(i, j) += src.n(i, j);
+			}
+		});
+		for (int j = 0; j < n; j++)
+			dst.u[j] += src.u[j];
+	}
+
+	NormalEqs::Sum* NormalEqs::getSum(int n)
+	{
+		Sum* pSum;
+		if (m_spare.empty())
+		{
+			m_sums.push_back(std::make_unique<Sum>());
+			pSum = m_sums.back().get();
+		}
+		else
+		{
+			pSum = m_spare.back();
+			m_spare.pop_back();
+		}
+		pSum->level = 0;
+		pSum->n.resize(n, n);
+		pSum->n.init(0);
+		pSum->u.assign(n, 0.0);
+		return pSum;
+	}
+	// End of NormalEqs implementation
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+}
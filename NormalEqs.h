@@ -0,0 +1,64 @@
+#pragma once
+
+#include "VecMat.h"
+#include "ThreadPool.h"
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////
+	// NormalEqs - sums the normal equations N x = U of a least squares fit over many
+	// observations in parallel. The observations are cut into chunks of c_chunk, each
+	// summed in order into a private upper triangle, and the chunk sums are added up
+	// by a fixed binary tree over the chunk indices. The result depends on the count
+	// of observations only, it is bitwise the same for any number of threads.
+	class NormalEqs
+	{
+	// Construction:
+	public:
+		NormalEqs();
+
+		// Accumulator of the calling thread, which keeps its pool and buffers between fits
+		static NormalEqs& getLocal();
+
+		enum { c_chunk = 256 };
+
+		// Fills the n values of the row of observation i and its value; false to skip it
+		typedef std::function<bool(int i, double* row, double& value, double& weight)> RowFn;
+
+	// Attributes:
+	public:
+		int threads;	// 0 for all hardware threads
+
+	// Operations:
+	public:
+		// Adds the observations [0, nObs) to the upper triangle of the leading n x n block of N
+		// and to the first n elements of U; fn is called from the threads of the pool
+		void accumulate(int n, int nObs, const RowFn& fn, Matrix& N, Vector& U);
+
+	// Implementation:
+	protected:
+		struct Sum
+		{
+			int level;			// Sum of 2^level chunks
+			Matrix n;			// Upper triangle
+			std::vector<double> u;
+		};
+		struct Scratch
+		{
+			std::vector<double> batch;	// c_batch rows
+			std::vector<double> weights;
+		};
+		enum { c_batch = 64 };	// Rows of a chunk per Matrix::syrk
+
+		ThreadPool m_pool;
+		std::vector<std::unique_ptr<Sum>> m_sums;
+		std::vector<Sum*> m_spare;
+		std::vector<Scratch> m_scratch; // Per pool thread
+
+		void sumChunk(int n, int nObs, int nChunk, const RowFn& fn, Sum& sum, Scratch& scratch) const;
+		void add(int n, Sum& dst, const Sum& src); // dst += src, upper triangles
+		Sum* getSum(int n);
+	};
+	// End of NormalEqs
+	////////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,84 @@
+#include "pch.h"
+
+#include "Numa.h"
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Numa implementation
+	const char* Numa::c_placements[(int)Placement::maxPlacement] = {
+		"local",
+		"first-touch",
+		"interleave"
+	};
+
+	int Numa::getNodeCount()
+	{
+		static const int nNodes = [] {
+			ULONG nHighest = 0;
+			if (!GetNumaHighestNodeNumber(&nHighest))
+				return 1;
+			return (int)nHighest + 1;
+		}();
+		return nNodes;
+	}
+
+	int Numa::getThreadNode(int nThread, int nThreads)
+	{
+		if (nThreads <= 0)
+			return 0;
+		return (int)((int64_t)nThread * getNodeCount() / nThreads);
+	}
+
+	void* Numa::alloc(size_t bytes, Placement placement)
+	{
+		int nNodes = getNodeCount();
+		if (placement != Placement::interleave || nNodes < 2)
+		{
+			void* p = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+			if (p == nullptr)
+				throw std::bad_alloc();
+			return p;
+		}
+
+		// Reserve the range and commit it in blocks of the allocation granularity,
+		// with the preferred node going round robin. A page lands on the preferred
+		// node of its block whichever thread touches it first.
+		char* p = (char*)VirtualAlloc(nullptr, bytes, MEM_RESERVE, PAGE_READWRITE);
+		if (p == nullptr)
+			throw std::bad_alloc();
+
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		size_t block = si.dwAllocationGranularity;
+		for (size_t offset = 0, k = 0; offset < bytes; offset += block, k++)
+		{
+			size_t n = std::min(block, bytes - offset);
+			if (VirtualAllocExNuma(GetCurrentProcess(), p + offset, n, MEM_COMMIT, PAGE_READWRITE, (DWORD)(k % nNodes)) == nullptr &&
+				VirtualAlloc(p + offset, n, MEM_COMMIT, PAGE_READWRITE) == nullptr)
+			{
+				VirtualFree(p, 0, MEM_RELEASE);
+				throw std::bad_alloc();
+			}
+		}
+		return p;
+	}
+
+	void Numa::free(void* p)
+	{
+		if (p != nullptr)
+			VirtualFree(p, 0, MEM_RELEASE);
+	}
+
+	// The processors of a node lie in one processor group, so the node mask is a group affinity
+	bool Numa::pinThread(int nNode)
+	{
+		GROUP_AFFINITY ga;
+		memset(&ga, 0, sizeof(ga));
+		if (!GetNumaNodeProcessorMaskEx((USHORT)nNode, &ga) || ga.Mask == 0)
+			return false;
+		return SetThreadGroupAffinity(GetCurrentThread(), &ga, nullptr) != FALSE;
+	}
+	// End of Numa implementation
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+}
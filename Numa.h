@@ -0,0 +1,114 @@
+#pragma once
+
+#include "PlaneFile.h"
+
+#include <type_traits>
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////
+	// Numa - NUMA nodes of the machine and the page placement of the grid planes.
+	// Windows puts a page on the node of the thread that first touches it, so a plane
+	// touched by the threads that later compute on its rows stays next to them.
+	class Numa
+	{
+	// Construction:
+	public:
+		enum class Placement
+		{
+			local = 0,		// Pages go wherever the thread that sets up the map touches them
+			firstTouch = 1,	// Rows are touched in parallel by the pool, band by band
+			interleave = 2,	// Pages go round robin over the nodes
+			maxPlacement
+		};
+		static const char* c_placements[(int)Placement::maxPlacement];
+
+	// Attributes:
+	public:
+		static int getNodeCount();
+		// Node of thread nThread when nThreads threads are spread over the nodes in contiguous blocks
+		static int getThreadNode(int nThread, int nThreads);
+
+	// Operations:
+	public:
+		// Zero filled pages nobody has touched yet, throws std::bad_alloc
+		static void* alloc(size_t bytes, Placement placement);
+		static void free(void* p);
+		// Restricts the calling thread to the processors of a node
+		static bool pinThread(int nNode);
+	};
+	// End of Numa
+	////////////////////////////////////////////////////////////////////////////////
+
+	// NumaPlane - zero initialised array of cells with its pages placed by Numa::alloc,
+	// or kept in a PlaneFile
+	template<class T>
+	class NumaPlane
+	{
+		static_assert(std::is_trivial<T>::value, "NumaPlane holds plain cells");
+
+	public:
+		NumaPlane() : m_p(nullptr), m_n(0) {}
+		~NumaPlane() {
+			clear();
+		}
+		NumaPlane(const NumaPlane&) = delete;
+		NumaPlane& operator=(const NumaPlane&) = delete;
+
+		void allocate(size_t n, Numa::Placement placement) {
+			clear();
+			if (n > 0)
+				m_p = (T*)Numa::alloc(n * sizeof(T), placement);
+			m_n = n;
+		}
+		bool map(const std::string& path, size_t n) {
+			clear();
+			m_pFile.reset(new PlaneFile());
+			if (!m_pFile->open(path, n * sizeof(T)))
+			{
+				m_pFile.reset();
+				return false;
+			}
+			m_p = (T*)m_pFile->getData();
+			m_n = n;
+			return true;
+		}
+		void swap(NumaPlane& other) {
+			std::swap(m_p, other.m_p);
+			std::swap(m_n, other.m_n);
+			std::swap(m_pFile, other.m_pFile);
+		}
+
+		// Hints of a walk over a mapped plane, nothing for one in memory
+		bool isMapped() const { return m_pFile != nullptr; }
+		void prefetch(size_t i, size_t n) const {
+			if (m_pFile)
+				m_pFile->prefetch(i * sizeof(T), n * sizeof(T));
+		}
+		void release(size_t i, size_t n) const {
+			if (m_pFile)
+				m_pFile->release(i * sizeof(T), n * sizeof(T));
+		}
+
+		T* data() { return m_p; }
+		const T* data() const { return m_p; }
+		size_t size() const { return m_n; }
+		T& operator[](size_t i) { return m_p[i]; }
+		const T& operator[](size_t i) const { return m_p[i]; }
+		size_t getMemorySize() const { return m_n * sizeof(T); }
+
+	protected:
+		T* m_p;
+		size_t m_n;
+		std::unique_ptr<PlaneFile> m_pFile;
+
+		void clear() {
+			if (m_pFile)
+				m_pFile.reset();
+			else
+				Numa::free(m_p);
+			m_p = nullptr;
+			m_n = 0;
+		}
+	};
+}
@@ -0,0 +1,346 @@
+#include "pch.h"
+
+#include "NzgApi.h"
+#include "NzgNode.h"
+
+#include <cfloat>
+#include <cmath>
+
+struct NzgEngine
+{
+	nzg::NzgNode node;
+	std::string error;
+	std::vector<int64_t> counts; // Cells per type id of nzgGetStats, kept between calls
+};
+
+namespace
+{
+	const char c_magic[4] = { 'N', 'Z', 'G', 'C' };
+	const int c_maxThreads = 1024;
+
+	// A finite value in [min, max], whole if bInteger; NaN fails every comparison
+	bool isInRange(double value, double min, double max, bool bInteger = false)
+	{
+		return std::isfinite(value) && value >= min && value <= max && (!bInteger || value == std::floor(value));
+	}
+
+	// Runs fn, turning what it throws into a status; no exception gets out to C
+	template<class Fn>
+	int guard(NzgEngine* engine, Fn fn)
+	{
+		if (engine == nullptr)
+			return NZG_BAD_ARGUMENT;
+		try
+		{
+			return fn();
+		}
+		catch (const std::bad_alloc&)
+		{
+			engine->error = "Out of memory";
+			return NZG_NO_MEMORY;
+		}
+		catch (const std::exception& e)
+		{
+			engine->error = e.what();
+			return NZG_ERROR;
+		}
+	}
+
+	int fail(NzgEngine* engine, int status, const char* error)
+	{
+		engine->error = error;
+		return status;
+	}
+
+}
+
+int nzgGetVersion(void)
+{
+	return NZG_API_VERSION;
+}
+
+NzgEngine* nzgCreate(void)
+{
+	try
+	{
+		return new NzgEngine();
+	}
+	catch (const std::exception&)
+	{
+		return nullptr;
+	}
+}
+
+void nzgDestroy(NzgEngine* engine)
+{
+	delete engine;
+}
+
+const char* nzgLastError(const NzgEngine* engine)
+{
+	return engine != nullptr ? engine->error.c_str() : "No engine";
+}
+
+int nzgSetParam(NzgEngine* engine, int param, double value)
+{
+	return guard(engine, [&]() {
+		nzg::NzgNode& node = engine->node;
+		if (!std::isfinite(value))
+			return fail(engine, NZG_BAD_ARGUMENT, "Value is not finite");
+		switch (param)
+		{
+		case NZG_SCHEDULE:
+			if (!isInRange(value, 0, (int)nzg::NzgNode::Schedule::maxSchedule - 1, true))
+				return fail(engine, NZG_BAD_ARGUMENT, "No such schedule");
+			node.schedule = (nzg::NzgNode::Schedule)(int)value;
+			break;
+		case NZG_RULE:
+			if (!isInRange(value, 0, (int)nzg::NzgNode::Rule::maxRule - 1, true))
+				return fail(engine, NZG_BAD_ARGUMENT, "No such rule");
+			node.rule = (nzg::NzgNode::Rule)(int)value;
+			break;
+		case NZG_FERMI_K:
+			if (!isInRange(value, 0, DBL_MAX))
+				return fail(engine, NZG_BAD_ARGUMENT, "Negative Fermi K");
+			node.fermiK = value;
+			break;
+		case NZG_MUTATION:
+			if (!isInRange(value, 0, 1))
+				return fail(engine, NZG_BAD_ARGUMENT, "Mutation is not a probability");
+			node.mutation = value;
+			break;
+		case NZG_GENOME_MEMORY:
+			if (!isInRange(value, 1, nzg::Genome::maxMemory, true))
+				return fail(engine, NZG_BAD_ARGUMENT, "No such genome memory");
+			node.genomeMemory = (int)value;
+			break;
+		case NZG_GENOME_POOL:
+			if (!isInRange(value, 1, nzg::StratTable::none - (int)nzg::Strat::Type::maxType, true))
+				return fail(engine, NZG_BAD_ARGUMENT, "Genome pool out of range");
+			node.genomePool = (int)value;
+			break;
+		case NZG_GENOME_MUTATION:
+			if (!isInRange(value, 0, 1))
+				return fail(engine, NZG_BAD_ARGUMENT, "Genome mutation is not a probability");
+			node.genomeMutation = value;
+			break;
+		case NZG_NOISE:
+			if (!isInRange(value, 0, 1))
+				return fail(engine, NZG_BAD_ARGUMENT, "Noise is not a probability");
+			node.noise = value;
+			break;
+		case NZG_THREADS:
+			if (!isInRange(value, 0, c_maxThreads, true))
+				return fail(engine, NZG_BAD_ARGUMENT, "Threads out of range");
+			node.threads = (int)value;
+			break;
+		case NZG_FUSED:
+			node.fused = value != 0;
+			break;
+		default:
+			return fail(engine, NZG_BAD_ARGUMENT, "No such parameter");
+		}
+		return (int)NZG_OK;
+	});
+}
+
+int nzgGetParam(const NzgEngine* engine, int param, double* value)
+{
+	if (engine == nullptr || value == nullptr)
+		return NZG_BAD_ARGUMENT;
+
+	const nzg::NzgNode& node = engine->node;
+	switch (param)
+	{
+	case NZG_SCHEDULE: *value = (int)node.schedule; break;
+	case NZG_RULE: *value = (int)node.rule; break;
+	case NZG_FERMI_K: *value = node.fermiK; break;
+	case NZG_MUTATION: *value = node.mutation; break;
+	case NZG_GENOME_MEMORY: *value = node.genomeMemory; break;
+	case NZG_GENOME_POOL: *value = node.genomePool; break;
+	case NZG_GENOME_MUTATION: *value = node.genomeMutation; break;
+	case NZG_NOISE: *value = node.noise; break;
+	case NZG_THREADS: *value = node.threads; break;
+	case NZG_FUSED: *value = node.fused ? 1 : 0; break;
+	default: return NZG_BAD_ARGUMENT;
+	}
+	return NZG_OK;
+}
+
+int nzgSeed(NzgEngine* engine, uint64_t seed)
+{
+	return guard(engine, [&]() {
+		engine->node.seed(seed);
+		return (int)NZG_OK;
+	});
+}
+
+int nzgSetMap(NzgEngine* engine, int mapType, int rows, int cols)
+{
+	return guard(engine, [&]() {
+		if (mapType < 0 || mapType >= (int)nzg::NzgNode::MapType::maxMapType)
+			return fail(engine, NZG_BAD_ARGUMENT, "No such map type");
+		if (rows <= 0 || cols <= 0)
+			return fail(engine, NZG_BAD_ARGUMENT, "Empty map");
+		engine->node.setMap((nzg::NzgNode::MapType)mapType, rows, cols);
+		return (int)NZG_OK;
+	});
+}
+
+int nzgSetTypes(NzgEngine* engine, const uint16_t* types, int rows, int cols)
+{
+	return guard(engine, [&]() {
+		if (types == nullptr || rows <= 0 || cols <= 0)
+			return fail(engine, NZG_BAD_ARGUMENT, "Empty map");
+		for (int64_t i = 0; i < (int64_t)rows * cols; i++)
+		{
+			if (types[i] >= (int)nzg::Strat::Type::maxType)
+				return fail(engine, NZG_BAD_ARGUMENT, "Type id out of range");
+		}
+
+		nzg::NzgNode& node = engine->node;
+		node.setMap(nzg::NzgNode::MapType::ordered, rows, cols);
+		for (int i = 0; i < rows; i++)
+			std::copy(types + (size_t)i * cols, types + (size_t)(i + 1) * cols, node.sts.getTypeRow(i));
+		return (int)NZG_OK;
+	});
+}
+
+int nzgPaint(NzgEngine* engine, int row, int col, int radius, uint16_t type)
+{
+	return guard(engine, [&]() {
+		if (radius < 0)
+			return fail(engine, NZG_BAD_ARGUMENT, "Negative radius");
+		if (!engine->node.strats.isValid(type))
+			return fail(engine, NZG_BAD_ARGUMENT, "Unknown type id");
+		engine->node.paint(row, col, radius, type);
+		return (int)NZG_OK;
+	});
+}
+
+int nzgStep(NzgEngine* engine, int nGenerations)
+{
+	return guard(engine, [&]() {
+		if (nGenerations < 0)
+			return fail(engine, NZG_BAD_ARGUMENT, "Negative number of generations");
+		engine->node.run(nGenerations);
+		return (int)NZG_OK;
+	});
+}
+
+int nzgGetSize(const NzgEngine* engine, int32_t* rows, int32_t* cols)
+{
+	if (engine == nullptr || rows == nullptr || cols == nullptr)
+		return NZG_BAD_ARGUMENT;
+	*rows = engine->node.sts.getRows();
+	*cols = engine->node.sts.getCols();
+	return NZG_OK;
+}
+
+const uint16_t* nzgGetTypes(const NzgEngine* engine)
+{
+	return engine != nullptr ? engine->node.sts.getTypes() : nullptr;
+}
+
+const int32_t* nzgGetScores(NzgEngine* engine)
+{
+	const int32_t* pScores = nullptr;
+	guard(engine, [&]() {
+		engine->node.updateScores();
+		pScores = engine->node.sts.getScores();
+		return (int)NZG_OK;
+	});
+	return pScores;
+}
+
+int nzgGetStats(NzgEngine* engine, NzgStats* stats, int64_t* counts, int32_t nCounts)
+{
+	return guard(engine, [&]() {
+		if (stats == nullptr || (counts == nullptr && nCounts > 0) || nCounts < 0)
+			return fail(engine, NZG_BAD_ARGUMENT, "No stats to fill");
+
+		nzg::NzgNode& node = engine->node;
+		node.updateScores();
+		engine->counts.assign(node.strats.getCount(), 0);
+		const nzg::TypeId* pTypes = node.sts.getTypes();
+		const int* pScores = node.sts.getScores();
+		int64_t n = node.sts.getSize();
+		int64_t sum = 0;
+		stats->minScore = n > 0 ? pScores[0] : 0;
+		stats->maxScore = stats->minScore;
+		for (int64_t i = 0; i < n; i++)
+		{
+			engine->counts[pTypes[i]]++;
+			sum += pScores[i];
+			stats->minScore = std::min(stats->minScore, pScores[i]);
+			stats->maxScore = std::max(stats->maxScore, pScores[i]);
+		}
+
+		stats->generation = node.getGeneration();
+		stats->rows = node.sts.getRows();
+		stats->cols = node.sts.getCols();
+		stats->typeCount = node.strats.getCount();
+		stats->genomeCount = node.strats.getGenomeCount();
+		stats->meanScore = n > 0 ? (double)sum / n : 0;
+		for (int32_t i = 0; i < nCounts; i++)
+			counts[i] = i < (int32_t)engine->counts.size() ? engine->counts[i] : 0;
+		return (int)NZG_OK;
+	});
+}
+
+int nzgGetTypeName(const NzgEngine* engine, uint16_t id, char* name, int32_t size)
+{
+	if (engine == nullptr || name == nullptr || size <= 0 || id >= engine->node.strats.getCount())
+		return NZG_BAD_ARGUMENT;
+
+	std::string s = engine->node.strats.get(id).getName();
+	size_t n = std::min(s.size(), (size_t)size - 1);
+	memcpy(name, s.data(), n);
+	name[n] = 0;
+	return NZG_OK;
+}
+
+int nzgSave(NzgEngine* engine, const char* path)
+{
+	return guard(engine, [&]() {
+		if (path == nullptr)
+			return fail(engine, NZG_BAD_ARGUMENT, "No path");
+
+		std::fstream f(std::filesystem::path(path), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!f)
+			return fail(engine, NZG_IO, "Can't create the checkpoint");
+		f.write(c_magic, sizeof(c_magic));
+		nzg::Archive ar(f, nzg::Archive::store);
+		engine->node.serialize(ar);
+		f.flush();
+		if (!f)
+			return fail(engine, NZG_IO, "Can't write the checkpoint");
+		return (int)NZG_OK;
+	});
+}
+
+int nzgLoad(NzgEngine* engine, const char* path)
+{
+	return guard(engine, [&]() {
+		if (path == nullptr)
+			return fail(engine, NZG_BAD_ARGUMENT, "No path");
+
+		std::fstream f(std::filesystem::path(path), std::ios::in | std::ios::binary);
+		char magic[sizeof(c_magic)];
+		if (!f || !f.read(magic, sizeof(magic)) || memcmp(magic, c_magic, sizeof(magic)) != 0)
+			return fail(engine, NZG_IO, "Not a checkpoint");
+
+		nzg::Archive ar(f, nzg::Archive::load);
+		try
+		{
+			engine->node.serialize(ar);
+		}
+		catch (const std::runtime_error& e)
+		{
+			// The parameters are kept, but a map half read is no use, start over with the default one
+			engine->node.setMap(nzg::NzgNode::MapType::random, 10, 10);
+			return fail(engine, NZG_IO, e.what());
+		}
+		return (int)NZG_OK;
+	});
+}
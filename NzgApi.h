@@ -0,0 +1,99 @@
+/* NzgApi.h - C interface of the simulation engine, exported by NzgEngine.dll.
+ *
+ * An engine is an opaque handle around one NzgNode. Calls return NZG_OK or a negative
+ * NzgStatus; nzgLastError() tells what went wrong. Stepping and reading the planes and
+ * the stats do not allocate, only the calls that make a new map and the checkpoints do,
+ * and nzgStep runs any number of generations in one call. The planes are handed out
+ * without copying and stay valid until the next call that changes the engine. One
+ * engine must not be used by two threads at once.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#ifdef NZG_API_EXPORTS
+#define NZG_API __declspec(dllexport)
+#else
+#define NZG_API __declspec(dllimport)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define NZG_API_VERSION 1
+
+typedef struct NzgEngine NzgEngine;
+
+typedef enum NzgStatus
+{
+	NZG_OK = 0,
+	NZG_ERROR = -1,			/* Anything else, see nzgLastError */
+	NZG_BAD_ARGUMENT = -2,
+	NZG_NO_MEMORY = -3,
+	NZG_IO = -4				/* The checkpoint could not be written or read */
+} NzgStatus;
+
+/* Parameters of nzgSetParam / nzgGetParam, enums go as their value. nzgSetParam takes
+ * finite values only, whole numbers where the parameter is a count or an enum */
+typedef enum NzgParam
+{
+	NZG_SCHEDULE = 0,		/* 0 synchronous, 1 random sequential, 2 random order */
+	NZG_RULE = 1,			/* 0 best, 1 fermi, 2 proportional */
+	NZG_FERMI_K = 2,		/* >= 0 */
+	NZG_MUTATION = 3,		/* Probabilities 0..1 */
+	NZG_GENOME_MEMORY = 4,	/* 1..3 */
+	NZG_GENOME_POOL = 5,	/* 1..65527 */
+	NZG_GENOME_MUTATION = 6,
+	NZG_NOISE = 7,
+	NZG_THREADS = 8,		/* 0..1024, 0 for all hardware threads */
+	NZG_FUSED = 9,
+	NZG_PARAM_COUNT
+} NzgParam;
+
+typedef struct NzgStats
+{
+	int64_t generation;
+	int32_t rows;
+	int32_t cols;
+	int32_t typeCount;		/* Type ids in use, the length of the counts of nzgGetStats */
+	int32_t genomeCount;
+	int32_t minScore;
+	int32_t maxScore;
+	double meanScore;
+} NzgStats;
+
+NZG_API int nzgGetVersion(void);
+
+NZG_API NzgEngine* nzgCreate(void);		/* NULL if out of memory */
+NZG_API void nzgDestroy(NzgEngine* engine);
+NZG_API const char* nzgLastError(const NzgEngine* engine);
+
+NZG_API int nzgSetParam(NzgEngine* engine, int param, double value);
+NZG_API int nzgGetParam(const NzgEngine* engine, int param, double* value);
+NZG_API int nzgSeed(NzgEngine* engine, uint64_t seed);
+
+/* A map of NzgNode::MapType, or a plane of rows * cols type ids below the type count */
+NZG_API int nzgSetMap(NzgEngine* engine, int mapType, int rows, int cols);
+NZG_API int nzgSetTypes(NzgEngine* engine, const uint16_t* types, int rows, int cols);
+/* Paints a disc of radius >= 0 with a live type id, rescoring around it to keep valid scores */
+NZG_API int nzgPaint(NzgEngine* engine, int row, int col, int radius, uint16_t type);
+
+NZG_API int nzgStep(NzgEngine* engine, int nGenerations);
+
+/* Row major planes of the current generation */
+NZG_API int nzgGetSize(const NzgEngine* engine, int32_t* rows, int32_t* cols);
+NZG_API const uint16_t* nzgGetTypes(const NzgEngine* engine);
+NZG_API const int32_t* nzgGetScores(NzgEngine* engine);
+
+/* Stats and, if counts is not null, the cells of the first nCounts type ids */
+NZG_API int nzgGetStats(NzgEngine* engine, NzgStats* stats, int64_t* counts, int32_t nCounts);
+/* Name of a type id, cut to size bytes with the terminating zero */
+NZG_API int nzgGetTypeName(const NzgEngine* engine, uint16_t id, char* name, int32_t size);
+
+NZG_API int nzgSave(NzgEngine* engine, const char* path);
+NZG_API int nzgLoad(NzgEngine* engine, const char* path);
+
+#ifdef __cplusplus
+}
+#endif
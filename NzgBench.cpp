@@ -0,0 +1,336 @@
+// NzgBench.cpp - throughput benchmark of the simulation engine.
+//
+// Runs every engine variant on square grids of the given sizes, for both map types
+// and 1..N threads, and writes a JSON report:
+//
+//   NzgBench [--sizes 16,64,...] [--threads N] [--maps random,ordered]
+//            [--variants sync-best,...] [--numa local,first-touch,interleave]
+//            [--time seconds] [--out report.json]
+//
+// --numa compares page placements of the planes on multi-socket machines. The pool
+// is pinned to the NUMA nodes for every placement but local, so the thread counts
+// past one socket show how the run scales onto the other one.
+//
+// The asynchronous schedules update one cell at a time on one thread, so they run
+// with 1 thread only, and on the default sizes only up to 1024x1024: a sweep of
+// 8192x8192 is 67M single-cell updates.
+//
+#include "pch.h"
+
+#include "NzgNode.h"
+
+#include <chrono>
+
+namespace
+{
+	using nzg::NzgNode;
+
+	// Engine variant: a schedule, a rule and the generation kernel
+	struct Variant
+	{
+		const char* name;
+		NzgNode::Schedule schedule;
+		NzgNode::Rule rule;
+		bool fused;
+		int maxSize;	// Of the default sizes, 0 for all
+
+		bool isSerial() const { return schedule != NzgNode::Schedule::synchronous; }
+	};
+
+	const int c_maxSerialSize = 1024;
+
+	const Variant c_variants[] = {
+		{ "sync-best", NzgNode::Schedule::synchronous, NzgNode::Rule::best, false, 0 },
+		{ "sync-best-fused", NzgNode::Schedule::synchronous, NzgNode::Rule::best, true, 0 },
+		{ "sync-fermi", NzgNode::Schedule::synchronous, NzgNode::Rule::fermi, false, 0 },
+		{ "sync-fermi-fused", NzgNode::Schedule::synchronous, NzgNode::Rule::fermi, true, 0 },
+		{ "sync-proportional", NzgNode::Schedule::synchronous, NzgNode::Rule::proportional, false, 0 },
+		{ "async-sequential-fermi", NzgNode::Schedule::randomSequential, NzgNode::Rule::fermi, false, c_maxSerialSize },
+		{ "async-order-fermi", NzgNode::Schedule::randomOrder, NzgNode::Rule::fermi, false, c_maxSerialSize }
+	};
+
+	const char* c_maps[] = { "random", "ordered" };
+
+	struct Settings
+	{
+		std::vector<int> sizes;
+		std::vector<int> threads;
+		std::vector<int> maps;
+		std::vector<int> variants;
+		std::vector<int> placements;
+		bool defaultSizes;
+		double minTime;
+		std::string out;
+
+		Settings() : defaultSizes(true), minTime(1.0) {
+			for (int n = 16; n <= 8192; n *= 2)
+				sizes.push_back(n);
+			for (int n = 1; n < nzg::ThreadPool::getHardwareThreads(); n *= 2)
+				threads.push_back(n);
+			threads.push_back(nzg::ThreadPool::getHardwareThreads());
+			maps = { 0, 1 };
+			for (int i = 0; i < (int)(sizeof(c_variants) / sizeof(c_variants[0])); i++)
+				variants.push_back(i);
+			placements = { (int)nzg::Numa::Placement::firstTouch };
+		}
+	};
+
+	struct Result
+	{
+		const Variant* variant;
+		int map;
+		int placement;
+		bool affinity;
+		int size;
+		int threads;
+		int steps;
+		double stepTime;	// Seconds per generation
+		double playTime;	// Seconds per play() of all cells
+		double bytesPerCell;
+		double efficiency;	// Speedup over 1 thread divided by the threads
+	};
+
+	std::vector<std::string> split(const std::string& str)
+	{
+		std::vector<std::string> items;
+		std::stringstream ss(str);
+		std::string item;
+		while (std::getline(ss, item, ','))
+		{
+			if (!item.empty())
+				items.push_back(item);
+		}
+		return items;
+	}
+
+	int findName(const std::string& name, const char* const* names, int nNames)
+	{
+		for (int i = 0; i < nNames; i++)
+		{
+			if (name == names[i])
+				return i;
+		}
+		return -1;
+	}
+
+	bool parse(int argc, char* argv[], Settings& s)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			std::string arg = argv[i];
+			if (i + 1 >= argc)
+				return false;
+			std::string val = argv[++i];
+
+			if (arg == "--sizes")
+			{
+				s.sizes.clear();
+				s.defaultSizes = false;
+				for (auto& it : split(val))
+					s.sizes.push_back(std::stoi(it));
+			}
+			else if (arg == "--threads")
+			{
+				int nMax = std::stoi(val);
+				s.threads.clear();
+				for (int n = 1; n < nMax; n *= 2)
+					s.threads.push_back(n);
+				s.threads.push_back(nMax);
+			}
+			else if (arg == "--maps")
+			{
+				s.maps.clear();
+				for (auto& it : split(val))
+				{
+					int n = findName(it, c_maps, 2);
+					if (n < 0)
+						return false;
+					s.maps.push_back(n);
+				}
+			}
+			else if (arg == "--variants")
+			{
+				s.variants.clear();
+				for (auto& it : split(val))
+				{
+					int n = -1;
+					for (int k = 0; k < (int)(sizeof(c_variants) / sizeof(c_variants[0])); k++)
+					{
+						if (it == c_variants[k].name)
+							n = k;
+					}
+					if (n < 0)
+						return false;
+					s.variants.push_back(n);
+				}
+			}
+			else if (arg == "--numa")
+			{
+				s.placements.clear();
+				for (auto& it : split(val))
+				{
+					int n = findName(it, nzg::Numa::c_placements, (int)nzg::Numa::Placement::maxPlacement);
+					if (n < 0)
+						return false;
+					s.placements.push_back(n);
+				}
+			}
+			else if (arg == "--time")
+			{
+				s.minTime = std::stod(val);
+			}
+			else if (arg == "--out")
+			{
+				s.out = val;
+			}
+			else
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	double seconds(std::chrono::steady_clock::time_point t0)
+	{
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+	}
+
+	Result measure(const Variant& v, int map, int placement, int size, int threads, double minTime)
+	{
+		Result r;
+		r.variant = &v;
+		r.map = map;
+		r.placement = placement;
+		r.affinity = placement != (int)nzg::Numa::Placement::local;
+		r.size = size;
+		r.threads = threads;
+		r.efficiency = 1;
+
+		NzgNode node;
+		node.threads = threads;
+		node.schedule = v.schedule;
+		node.rule = v.rule;
+		node.fused = v.fused;
+		node.placement = (nzg::Numa::Placement)placement;
+		node.affinity = r.affinity;
+		node.seed(1);
+		node.setMap((NzgNode::MapType)map, size, size);
+
+		// The first play warms up the payoff table and the pool
+		node.resetTotalScores();
+		node.play();
+
+		r.steps = 0;
+		auto t0 = std::chrono::steady_clock::now();
+		double t = 0;
+		do
+		{
+			// The fused kernel leaves the scores to the end of a run, time it in the steady state
+			if (v.fused)
+				node.stepFused();
+			else
+				node.step();
+			r.steps++;
+			t = seconds(t0);
+		} while (t < minTime);
+		r.stepTime = t / r.steps;
+
+		t0 = std::chrono::steady_clock::now();
+		node.resetTotalScores();
+		node.play();
+		r.playTime = seconds(t0);
+
+		r.bytesPerCell = (double)node.getMemorySize() / ((double)size * size);
+		return r;
+	}
+
+	void writeJson(std::ostream& os, const std::vector<Result>& results)
+	{
+		os << "{\n";
+		os << "  \"hardwareThreads\": " << nzg::ThreadPool::getHardwareThreads() << ",\n";
+		os << "  \"numaNodes\": " << nzg::Numa::getNodeCount() << ",\n";
+		os << "  \"results\": [\n";
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const Result& r = results[i];
+			double cells = (double)r.size * r.size;
+			os << "    { \"variant\": \"" << r.variant->name << "\"";
+			os << ", \"map\": \"" << c_maps[r.map] << "\"";
+			os << ", \"placement\": \"" << nzg::Numa::c_placements[r.placement] << "\"";
+			os << ", \"affinity\": " << (r.affinity ? "true" : "false");
+			os << ", \"rows\": " << r.size << ", \"cols\": " << r.size;
+			os << ", \"threads\": " << r.threads;
+			os << ", \"nodes\": " << (r.affinity ? std::min(r.threads, nzg::Numa::getNodeCount()) : 0);
+			os << ", \"steps\": " << r.steps;
+			os << ", \"secondsPerStep\": " << r.stepTime;
+			os << ", \"cellsPerSec\": " << cells / r.stepTime;
+			os << ", \"gamesPerSec\": " << 8 * cells / r.playTime;
+			os << ", \"bytesPerCell\": " << r.bytesPerCell;
+			os << ", \"efficiency\": " << r.efficiency << " }";
+			os << (i + 1 < results.size() ? ",\n" : "\n");
+		}
+		os << "  ]\n";
+		os << "}\n";
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	Settings s;
+	if (!parse(argc, argv, s))
+	{
+		std::cerr << "Usage: NzgBench [--sizes 16,64,...] [--threads N] [--maps random,ordered]\n"
+			"                [--variants name,...] [--numa local,first-touch,interleave]\n"
+			"                [--time seconds] [--out report.json]\n";
+		return 1;
+	}
+
+	std::vector<Result> results;
+	for (int nVariant : s.variants)
+	{
+		const Variant& v = c_variants[nVariant];
+		for (int map : s.maps)
+		{
+			for (int placement : s.placements)
+			{
+				for (int size : s.sizes)
+				{
+					if (s.defaultSizes && v.maxSize > 0 && size > v.maxSize)
+						continue;
+
+					double stepTime1 = 0;
+					for (int threads : s.threads)
+					{
+						if (v.isSerial() && threads != 1)
+							continue;
+
+						Result r = measure(v, map, placement, size, threads, s.minTime);
+						if (threads == 1)
+							stepTime1 = r.stepTime;
+						if (stepTime1 > 0)
+							r.efficiency = stepTime1 / (r.stepTime * threads);
+						results.push_back(r);
+
+						std::cerr << r.variant->name << " " << c_maps[map] << " " << nzg::Numa::c_placements[placement]
+							<< " " << size << "x" << size << " threads " << threads << ": "
+							<< (double)size * size / r.stepTime << " cells/s\n";
+					}
+				}
+			}
+		}
+	}
+
+	std::cout << std::setprecision(6);
+	if (s.out.empty())
+	{
+		writeJson(std::cout, results);
+	}
+	else
+	{
+		std::ofstream ofs(s.out);
+		ofs << std::setprecision(6);
+		writeJson(ofs, results);
+	}
+	return 0;
+}
@@ -1,6 +1,9 @@
 #include "pch.h"
 
 #include "NzgNode.h"
+#include "MapGen.h"
+
+#include <random>
 
 namespace nzg
 {
@@ -15,10 +18,18 @@ namespace nzg
 		"graaskamp",
 		"titfortat",
 		"random",
-		"maxType"
+		"maxType",
+		"genome"
 	};
 
-	Strat::Strat() : type (Type::maxType), score(0), totalScore(0)
+	std::string Genome::getName() const
+	{
+		char sz[32];
+		snprintf(sz, sizeof(sz), "m%d:%llx", n, (unsigned long long)table);
+		return sz;
+	}
+
+	Strat::Strat() : type (Type::maxType)
 	{
 	}
 
@@ -26,7 +37,7 @@ namespace nzg
 	{
 	}
 
-	bool Strat::play(std::vector<bool>& my, std::vector<bool>& his)
+	bool Strat::play(std::vector<bool>& my, std::vector<bool>& his, Rng& rng)
 	{
 		if (type == Type::yes)
 			return true;
@@ -36,9 +47,7 @@ namespace nzg
 		{
 			if (my.size() == 0)
 				return true;
-			int rand = std::rand();
-
-			if ((double)rand / (double)RAND_MAX < 0.1)
+			if (rng.uniform() < 0.1)
 				return false;
 			return his.back();
 		}
@@ -56,12 +65,18 @@ namespace nzg
 				return true;
 			return his.back();
 		}
+		else if (type == Type::genome)
+		{
+			// Replay the last n joint moves into the state
+			int state = genome.getFirstState();
+			size_t i = my.size() > (size_t)genome.n ? my.size() - genome.n : 0;
+			for (; i < my.size(); i++)
+				state = genome.nextState(state, my[i], his[i]);
+			return genome.move(state);
+		}
 		else if (type == Type::random)
 		{
-			int rand = std::rand();
-			if (rand < RAND_MAX / 2)
-				return true;
-			return false;
+			return (rng.next() >> 63) != 0;
 		}
 		return false;
 	}
@@ -105,9 +120,23 @@ namespace nzg
 			0xE00000, 0x00E000, 0x0000E0, 0xE0E000, 0xE000E0, 0x00E0E0, 0xE0E0E0
 		};
 
+		if (type == Type::genome)
+		{
+			// Genomes are too many for the table, take the colour from the hashed table bits
+			uint64_t h = Genome::Hash()(genome) * 0xBF58476D1CE4E5B9ull;
+			return (DWORD)(h >> 40) & 0xFFFFFF;
+		}
+
 		int nt = (int)type;
 		return clrs[nt % 56];
 	}
+
+	std::string Strat::getName() const
+	{
+		if (type == Type::genome)
+			return genome.getName();
+		return c_types[(int)type];
+	}
 	// End of Strat implementation
 	////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -116,28 +145,439 @@ namespace nzg
 	StratMatrix::StratMatrix()
 	{
 		rows = cols = 0;
+		tileRows = 0;
 	}
 
 	StratMatrix::~StratMatrix()
 	{
 	}
 
-	void StratMatrix::resize(int rows_, int cols_)
+	// The planes come zero filled and untouched. With first touch the pool writes the
+	// zeros over the same row chunks its loops use, so each page lands on the node of
+	// the thread that works on its rows.
+	void StratMatrix::resize(int rows_, int cols_, Numa::Placement placement, ThreadPool* pPool)
 	{
 		rows = rows_;
 		cols = cols_;
-		sts.resize(rows * cols);
+		tileRows = 0;
+		size_t n = (size_t)rows * cols;
+		types.allocate(n, placement);
+		nextTypes.allocate(n, placement);
+		scores.allocate(n, placement);
+
+		if (placement == Numa::Placement::firstTouch && pPool != nullptr)
+		{
+			pPool->parallelFor(rows, [&](int row0, int row1, int) {
+				size_t i0 = (size_t)row0 * cols;
+				size_t i1 = (size_t)row1 * cols;
+				std::fill(types.data() + i0, types.data() + i1, (TypeId)0);
+				std::fill(nextTypes.data() + i0, nextTypes.data() + i1, (TypeId)0);
+				std::fill(scores.data() + i0, scores.data() + i1, 0);
+			});
+		}
+	}
+
+	// Tiles of about 4 MB of types
+	bool StratMatrix::map(const std::string& dir, int rows_, int cols_)
+	{
+		std::filesystem::path path(dir);
+		size_t n = (size_t)rows_ * cols_;
+		if (!types.map((path / "types.nzp").string(), n) || !nextTypes.map((path / "next.nzp").string(), n) ||
+			!scores.map((path / "scores.nzp").string(), n))
+		{
+			resize(0, 0);
+			return false;
+		}
+		rows = rows_;
+		cols = cols_;
+		tileRows = std::max(1, (int)((4 << 20) / ((size_t)std::max(cols, 1) * sizeof(TypeId))));
+		return true;
 	}
 
+	void StratMatrix::streamTiles(int row, int row0, int row1) const
+	{
+		auto prefetch = [&](int r) {
+			size_t i = (size_t)r * cols;
+			size_t n = (size_t)(std::min(r + tileRows, row1) - r) * cols;
+			types.prefetch(i, n);
+			nextTypes.prefetch(i, n);
+			scores.prefetch(i, n);
+		};
+		if (row == row0)
+			prefetch(row);
+		if (row + tileRows < row1)
+			prefetch(row + tileRows);
+		if (row - 2 * tileRows > row0)
+		{
+			size_t i = (size_t)(row - 2 * tileRows) * cols;
+			size_t tile = (size_t)tileRows * cols;
+			types.release(i, tile);
+			nextTypes.release(i, tile);
+			scores.release(i, tile);
+		}
+	}
 
 	// End of StratMatrix implementation
 	////////////////////////////////////////////////////////////////////////////////////////////////////
 
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	// StratTable implementation
+	StratTable::StratTable() : m_cap(0)
+	{
+		reset();
+	}
+
+	StratTable::~StratTable()
+	{
+	}
+
+	void StratTable::reset()
+	{
+		m_strats.clear();
+		for (int i = 0; i < (int)Strat::Type::maxType; i++)
+			m_strats.push_back(Strat((Strat::Type)i));
+		m_ids.clear();
+		m_free.clear();
+		m_cap = 0;
+		m_pay = std::vector<std::atomic<int16_t>>();
+	}
+
+	TypeId StratTable::intern(const Genome& g)
+	{
+		auto it = m_ids.find(g);
+		if (it != m_ids.end())
+			return it->second;
+
+		TypeId id;
+		if (!m_free.empty())
+		{
+			id = m_free.back();
+			m_free.pop_back();
+			m_strats[id] = Strat(g);
+		}
+		else
+		{
+			if (m_strats.size() >= none)
+				return none;
+			id = (TypeId)m_strats.size();
+			m_strats.push_back(Strat(g));
+		}
+		m_ids[g] = id;
+		return id;
+	}
+
+	size_t StratTable::getMemorySize() const
+	{
+		// Hash nodes are estimated as the pair plus a next pointer and the stored hash
+		return m_strats.capacity() * sizeof(Strat) + m_pay.size() * sizeof(int16_t) +
+			m_ids.size() * (sizeof(std::pair<Genome, TypeId>) + 2 * sizeof(void*)) +
+			m_ids.bucket_count() * sizeof(void*) + m_free.capacity() * sizeof(TypeId);
+	}
+
+	TypeId StratTable::mutate(TypeId id, Rng& rng)
+	{
+		if (!isGenome(id))
+			return id;
+
+		Genome g = m_strats[id].genome;
+		g.table ^= 1ull << rng.below(g.getStates());
+		TypeId nid = intern(g);
+		return nid == none ? id : nid;
+	}
+
+	// counts[id] is the number of cells holding id, ids past its end count as unused
+	void StratTable::collect(const std::vector<uint32_t>& counts)
+	{
+		bool bFreed = false;
+		for (int id = (int)Strat::Type::maxType; id < getCount(); id++)
+		{
+			Strat& st = m_strats[id];
+			if (st.genome.n == 0 || (id < (int)counts.size() && counts[id] > 0))
+				continue;
+
+			m_ids.erase(st.genome);
+			st.genome = Genome();
+			invalidate((TypeId)id);
+			m_free.push_back((TypeId)id);
+			bFreed = true;
+		}
+
+		if (bFreed)
+			std::sort(m_free.begin(), m_free.end(), std::greater<TypeId>());
+	}
+
+	// The genomes by id, memory 0 for a released id; the payoff cache fills again on use
+	void StratTable::swap(StratTable& other)
+	{
+		m_strats.swap(other.m_strats);
+		m_ids.swap(other.m_ids);
+		m_free.swap(other.m_free);
+		std::swap(m_cap, other.m_cap);
+		m_pay.swap(other.m_pay);
+	}
+
+	void StratTable::serialize(Archive& ar)
+	{
+		DWORD dwVer = 1;
+		if (ar.isStoring())
+		{
+			ar << dwVer;
+			ar << getCount();
+			for (int id = (int)Strat::Type::maxType; id < getCount(); id++)
+			{
+				ar << m_strats[id].genome.n;
+				ar.write(&m_strats[id].genome.table, sizeof(uint64_t));
+			}
+		}
+		else
+		{
+			int nCount;
+			ar >> dwVer;
+			ar >> nCount;
+			reset();
+			for (int id = (int)Strat::Type::maxType; id < nCount; id++)
+			{
+				Genome g;
+				ar >> g.n;
+				ar.read(&g.table, sizeof(uint64_t));
+				if (g.n < 0 || g.n > Genome::maxMemory || id >= none)
+					throw std::runtime_error("Bad genome in archive");
+
+				m_strats.push_back(Strat(g));
+				if (g.n == 0)
+					m_free.push_back((TypeId)id);
+				else
+					m_ids[g] = (TypeId)id;
+			}
+			std::sort(m_free.begin(), m_free.end(), std::greater<TypeId>());
+		}
+	}
+
+	void StratTable::matchSlow(TypeId a, TypeId b, int& s1, int& s2, Rng& rng)
+	{
+		Strat& st1 = m_strats[a];
+		Strat& st2 = m_strats[b];
+		NZG_PROF_COUNT(Profiler::cntSimulated, 1);
+		simulate(st1, st2, s1, s2, rng);
+
+		if (!st1.isDeterministic() || !st2.isDeterministic() || a >= maxCached || b >= maxCached)
+			return;
+
+		// Only serial callers get here with new ids, parallel ones call reserveCache first
+		growCache(std::max(a, b));
+
+		// Threads racing on the same pair store the same values
+		m_pay[a * m_cap + b].store((int16_t)s1, std::memory_order_relaxed);
+		m_pay[b * m_cap + a].store((int16_t)s2, std::memory_order_relaxed);
+	}
+
+	void StratTable::reserveCache()
+	{
+		growCache(std::min(getCount(), (int)maxCached) - 1);
+	}
+
+	// Grow the table by doubling until it holds id nMax, keeping what is known
+	void StratTable::growCache(int nMax)
+	{
+		if (nMax < m_cap)
+			return;
+
+		int cap = std::max(m_cap, 64);
+		while (cap <= nMax)
+			cap *= 2;
+		cap = std::min(cap, (int)maxCached);
+
+		std::vector<std::atomic<int16_t>> pay(cap * cap);
+		for (int i = 0; i < cap; i++)
+		{
+			for (int j = 0; j < cap; j++)
+			{
+				int16_t v = i < m_cap && j < m_cap ? m_pay[i * m_cap + j].load(std::memory_order_relaxed) : (int16_t)-1;
+				pay[i * cap + j].store(v, std::memory_order_relaxed);
+			}
+		}
+		m_pay.swap(pay);
+		m_cap = cap;
+	}
+
+	void StratTable::invalidate(TypeId id)
+	{
+		if (id >= m_cap)
+			return;
+
+		for (int i = 0; i < m_cap; i++)
+		{
+			m_pay[id * m_cap + i].store(-1, std::memory_order_relaxed);
+			m_pay[i * m_cap + id].store(-1, std::memory_order_relaxed);
+		}
+	}
+
+	void StratTable::simulate(Strat& st1, Strat& st2, int& s1, int& s2, Rng& rng, uint64_t flips1, uint64_t flips2,
+		int nRounds)
+	{
+		s1 = s2 = 0;
+		if (st1.isGenome() && st2.isGenome())
+		{
+			// Both strategies are state machines, no need for the move history
+			const Genome& g1 = st1.genome;
+			const Genome& g2 = st2.genome;
+			int q1 = g1.getFirstState();
+			int q2 = g2.getFirstState();
+			for (int p = 0; p < nRounds; p++)
+			{
+				bool b1 = g1.move(q1) != (p < 64 && ((flips1 >> p) & 1) != 0);
+				bool b2 = g2.move(q2) != (p < 64 && ((flips2 >> p) & 1) != 0);
+				q1 = g1.nextState(q1, b1, b2);
+				q2 = g2.nextState(q2, b2, b1);
+				s1 += b1 ? (b2 ? 3 : 0) : (b2 ? 5 : 1);
+				s2 += b2 ? (b1 ? 3 : 0) : (b1 ? 5 : 1);
+			}
+			return;
+		}
+
+		std::vector<bool> r1;
+		std::vector<bool> r2;
+		r1.reserve(nRounds);
+		r2.reserve(nRounds);
+		for (int p = 0; p < nRounds; p++)
+		{
+			bool b1 = st1.play(r1, r2, rng) != (p < 64 && ((flips1 >> p) & 1) != 0);
+			bool b2 = st2.play(r2, r1, rng) != (p < 64 && ((flips2 >> p) & 1) != 0);
+			r1.push_back(b1);
+			r2.push_back(b2);
+			if (b1 && b2)
+			{
+				s1 += 3;
+				s2 += 3;
+			}
+			else if (b1 && !b2)
+			{
+				s2 += 5;
+			}
+			else if (!b1 && b2)
+			{
+				s1 += 5;
+			}
+			else
+			{
+				s1 += 1;
+				s2 += 1;
+			}
+		}
+	}
+	// End of StratTable implementation
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	// MoveNoise implementation
+	void MoveNoise::setRate(double eps, Rng& rng)
+	{
+		m_eps = std::min(std::max(eps, 0.0), 1.0);
+		m_logq = m_eps < 1 ? std::log1p(-m_eps) : -HUGE_VAL;
+		m_skip = nextSkip(rng);
+	}
+
+	// Number of error free moves before the next error: floor(log(u) / log(1 - eps))
+	int64_t MoveNoise::nextSkip(Rng& rng) const
+	{
+		if (m_eps <= 0)
+			return INT64_MAX;
+
+		double u = 1.0 - rng.uniform(); // (0, 1]
+		double skip = std::floor(std::log(u) / m_logq);
+		return skip < 1e18 ? (int64_t)skip : INT64_MAX;
+	}
+
+	// Moves of a match are numbered 2 * round + player
+	bool MoveNoise::drawSlow(Rng& rng, uint64_t& flips1, uint64_t& flips2)
+	{
+		flips1 = flips2 = 0;
+		int64_t pos = m_skip;
+		while (pos < 2 * c_rounds)
+		{
+			uint64_t bit = 1ull << (pos >> 1);
+			if (pos & 1)
+				flips2 |= bit;
+			else
+				flips1 |= bit;
+
+			int64_t skip = nextSkip(rng);
+			pos = skip < INT64_MAX - pos ? pos + 1 + skip : INT64_MAX;
+		}
+		m_skip = pos - 2 * c_rounds;
+		return true;
+	}
+	// End of MoveNoise implementation
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+
 	////////////////////////////////////////////////////////////////////////////////////////////////////
 	// NzgNode implementation
-	NzgNode::NzgNode()
+	const char* NzgNode::c_mapTypes[(int)MapType::maxMapType + 1] = {
+		"random",
+		"ordered",
+		"genomes",
+		"uniform",
+		"voronoi",
+		"stripes",
+		"invader",
+		"bitmap"
+	};
+
+	// Map type of each MapGen::Pattern
+	static const NzgNode::MapType c_patternMapTypes[(int)MapGen::Pattern::maxPattern] = {
+		NzgNode::MapType::uniform,
+		NzgNode::MapType::voronoi,
+		NzgNode::MapType::stripes,
+		NzgNode::MapType::invader,
+		NzgNode::MapType::bitmap
+	};
+
+	const char* NzgNode::c_schedules[(int)Schedule::maxSchedule] = {
+		"synchronous",
+		"random sequential",
+		"random order"
+	};
+
+	const char* NzgNode::c_rules[(int)Rule::maxRule] = {
+		"imitate best",
+		"Fermi",
+		"proportional"
+	};
+
+	const std::pair<int, int> NzgNode::c_neis[8] = { {-1, -1}, {-1, 0}, {-1, 1}, {0, 1}, {1, 1}, {1, 0}, {1, -1}, {0, -1} };
+
+	// Types drawn on mutation
+	static const Strat::Type c_mutants[] = {
+		Strat::Type::yes, Strat::Type::no, Strat::Type::friedman, Strat::Type::joss,
+		Strat::Type::graaskamp, Strat::Type::titfortat, Strat::Type::random
+	};
+
+	// Largest score difference of two cells: 16 games of 50 rounds with payoffs 0..5
+	static const float c_maxScoreDiff = 16 * 50 * 5;
+
+	// exp(x) for float arrays. Written without calls and branches so that the compiler
+	// vectorises the loops using it: x = n*ln2 + f*ln2, |f| <= 1/2, and 2^f by its series.
+	static inline float expApprox(float x)
+	{
+		x = std::min(std::max(x, -80.0f), 80.0f);
+		float t = x * 1.44269504f;
+		float n = std::floor(t + 0.5f);
+		float f = (t - n) * 0.69314718f;
+		float p = 1.0f + f * (1.0f + f * (0.5f + f * (1.0f / 6 + f * (1.0f / 24 + f * (1.0f / 120 + f * (1.0f / 720))))));
+		int32_t bits = ((int32_t)n + 127) << 23;
+		float scale;
+		memcpy(&scale, &bits, sizeof(scale));
+		return p * scale;
+	}
+
+	NzgNode::NzgNode() : schedule(Schedule::synchronous), rule(Rule::best), fermiK(0.1 * 16 * 50), mutation(0),
+		genomeMemory(1), genomePool(64), genomeMutation(0), noise(0), threads(0), fused(true),
+		placement(Numa::Placement::firstTouch), affinity(false), trackChanges(false), m_mapType(MapType::random),
+		m_bScored(false), m_nPassSeed(0), m_nGeneration(0), m_bChangesLost(true)
 	{
 		m_ent = entNzg;
+		std::random_device rd;
+		m_rng.seed(((uint64_t)rd() << 32) | rd());
 		setMap(MapType::random, 10, 10);
 	}
 
@@ -147,7 +587,24 @@ namespace nzg
 
 	void NzgNode::setMap(MapType mt, int rows, int cols)
 	{
-		sts.resize(rows, cols);
+		if (mt == MapType::bitmap)
+			throw std::runtime_error("A bitmap map needs its picture");
+		if (mt >= MapType::uniform)
+		{
+			MapGen gen(mt == MapType::voronoi ? MapGen::Pattern::voronoi : mt == MapType::stripes ? MapGen::Pattern::stripes :
+				mt == MapType::invader ? MapGen::Pattern::invader : MapGen::Pattern::uniform);
+			gen.seed = m_rng.next();
+			if (mt == MapType::invader)
+				gen.types = { (TypeId)Strat::Type::titfortat, (TypeId)Strat::Type::no };
+			setMap(gen, rows, cols);
+			return;
+		}
+
+		allocateMap(rows, cols);
+		strats.reset();
+		m_mapType = mt;
+		m_bScored = false;
+		m_nGeneration = 0;
 
 		if (mt == MapType::random)
 		{
@@ -155,11 +612,32 @@ namespace nzg
 			{
 				for (int j = 0; j < cols; j++)
 				{
-					double r = std::rand() / (double)RAND_MAX;
+					double r = m_rng.uniform();
 					Strat::Type nt = (Strat::Type)(((int)Strat::Type::maxType - 1) * r);
 					if (nt == Strat::Type::maxType)
 						nt = Strat::Type::titfortat;
-					sts(i, j) = std::shared_ptr<Strat>(new Strat(nt));
+					sts.type(i, j) = (TypeId)nt;
+				}
+			}
+		}
+		else if (mt == MapType::genomes)
+		{
+			std::vector<TypeId> pool;
+			for (int k = 0; k < genomePool; k++)
+			{
+				TypeId id = strats.intern(Genome(std::min(std::max(genomeMemory, 1), (int)Genome::maxMemory), m_rng.next()));
+				if (id == StratTable::none)
+					break;
+				pool.push_back(id);
+			}
+			if (pool.empty())
+				pool.push_back((TypeId)Strat::Type::titfortat);
+
+			for (int i = 0; i < rows; i++)
+			{
+				for (int j = 0; j < cols; j++)
+				{
+					sts.type(i, j) = pool[m_rng.below((uint32_t)pool.size())];
 				}
 			}
 		}
@@ -170,147 +648,890 @@ namespace nzg
 				Strat::Type nt = (Strat::Type)(((int)Strat::Type::maxType-1) * i / rows);
 				for (int j = 0; j < cols; j++)
 				{
-					sts(i, j) = std::shared_ptr<Strat>(new Strat(nt));
+					sts.type(i, j) = (TypeId)nt;
 				}
 			}
 		}
 	}
 
+	void NzgNode::setMap(const MapGen& gen, int rows, int cols)
+	{
+		allocateMap(rows, cols);
+		strats.reset();
+		m_mapType = c_patternMapTypes[(int)gen.pattern];
+		m_bScored = false;
+		m_nGeneration = 0;
+		gen.generate(sts, m_pool);
+	}
+
+	void NzgNode::allocateMap(int rows, int cols)
+	{
+		loseChanges();
+		m_pool.setAffinity(affinity);
+		m_pool.setThreads(threads);
+		if (storage.empty())
+			sts.resize(rows, cols, placement, &m_pool);
+		else if (!sts.map(storage, rows, cols))
+			throw std::runtime_error("Can't map the plane files in " + storage);
+	}
+
+	void NzgNode::forBands(const std::function<void(int, int, int)>& fn)
+	{
+		int rows = sts.getRows();
+		int tile = std::max(sts.getTileRows(), 1);
+		m_pool.parallelFor((rows + tile - 1) / tile, [&](int tile0, int tile1, int thread) {
+			fn(tile0 * tile, std::min(tile1 * tile, rows), thread);
+		});
+	}
+
+	// Every cell plays the 8 games it starts and adds the scores to both players.
+	// A cell writes to the rows next to its own, so in parallel the grid is split into
+	// an even number of bands of 2 rows or more, and the even and the odd ones take turns.
+	// The bands are made of whole tiles of the mapped planes, two at least.
 	void NzgNode::play()
 	{
-		CWaitCursor wc;
+		NZG_PROF_SCOPE("NzgNode::play");
+		prepareWorkers();
+		strats.reserveCache();
+		m_nPassSeed = m_rng.next();
 
-		std::pair<int, int> neis[8] = { {-1, -1}, {-1, 0}, {-1, 1}, {0, 1}, {1, 1}, {1, 0}, {1, -1}, {0, -1} };
-		for (int i = 0; i < sts.getRows(); i++)
+		int rows = sts.getRows();
+		int tile = std::max(sts.getTileRows(), 1);
+		int nTiles = (rows + tile - 1) / tile;
+		int nThreads = m_pool.getThreads();
+		int nBands = std::min(nTiles / 2, 4 * nThreads) & ~1;
+		if (nThreads == 1 || nBands < 2)
+		{
+			playRows(0, rows, m_workers[0]);
+		}
+		else
 		{
+			for (int nPhase = 0; nPhase < 2; nPhase++)
+			{
+				m_pool.run(nBands / 2, [&](int task, int thread) {
+					int b = 2 * task + nPhase;
+					playRows(b * nTiles / nBands * tile, std::min((b + 1) * nTiles / nBands * tile, rows), m_workers[thread]);
+				});
+			}
+		}
+
+		m_bScored = true;
+	}
+
+	void NzgNode::playRows(int row0, int row1, Worker& w)
+	{
+		NZG_PROF_SCOPE("NzgNode::playRows");
+		NZG_PROF_COUNT(Profiler::cntGames, 8ll * (row1 - row0) * sts.getCols());
+		for (int i = row0; i < row1; i++)
+		{
+			sts.streamRow(i, row0, row1);
+			seedStream(w, 2 * (uint64_t)i);
 			for (int j = 0; j < sts.getCols(); j++)
 			{
-				Strat* ps1 = sts(i, j).get();
+				TypeId t1 = sts.type(i, j);
 
 				for (int k = 0; k < 8; k++)
 				{
-					int m = i + neis[k].first;
-					int n = j + neis[k].second;
-
-					if (m < 0)
-						m += sts.getRows();
-					if (m >= sts.getRows())
-						m -= sts.getRows();
-					if (n < 0)
-						n += sts.getCols();
-					if (n >= sts.getCols())
-						n -= sts.getCols();
-
-					Strat* ps2 = sts(m, n).get();
-
-					std::vector<bool> r1;
-					std::vector<bool> r2;
-					for (int p = 0; p < 50; p++)
-					{
-						bool b1 = ps1->play(r1, r2);
-						bool b2 = ps2->play(r2, r1);
-						r1.push_back(b1);
-						r2.push_back(b2);
-						int s1 = 0;
-						int s2 = 0;
-						if (b1 && b2)
-						{
-							s1 = s2 = 3;
-						}
-						else if (b1 && !b2)
-						{
-							s1 = 0;
-							s2 = 5;
-						}
-						else if (!b1 && b2)
-						{
-							s1 = 5;
-							s2 = 0;
-						}
-						else if (!b1 && !b2)
-						{
-							s1 = 1;
-							s2 = 1;
-						}
-						ps1->score += s1;
-						ps1->totalScore += s1;
-						ps2->score += s2;
-						ps2->totalScore += s2;
-					}
-					ps1->score = 0;
-					ps2->score = 0;
+					int m = sts.wrapRow(i + c_neis[k].first);
+					int n = sts.wrapCol(j + c_neis[k].second);
+
+					int s1 = 0;
+					int s2 = 0;
+					match(t1, sts.type(m, n), s1, s2, w);
+					sts.score(i, j) += s1;
+					sts.score(m, n) += s2;
 				}
 			}
 		}
 	}
 
+	void NzgNode::updateScores()
+	{
+		if (!m_bScored)
+		{
+			resetTotalScores();
+			play();
+		}
+	}
+
 	void NzgNode::resetTotalScores()
 	{
-		for (int i = 0; i < sts.getRows(); i++)
+		forBands([&](int row0, int row1, int) {
+			for (int i = row0; i < row1; i++)
+			{
+				sts.streamRow(i, row0, row1);
+				int* pRow = sts.getScoreRow(i);
+				std::fill(pRow, pRow + sts.getCols(), 0);
+			}
+		});
+		m_bScored = false;
+	}
+
+	// Returns the type the cell (row, col) adopts or StratTable::none if it keeps its own one.
+	// A cell imitates its best neighbour unless it is better than any of them.
+	TypeId NzgNode::decideBest(int row, int col) const
+	{
+		int score = sts.score(row, col);
+		int maxScore = 0;
+		TypeId bestType = StratTable::none;
+		for (int k = 0; k < 8; k++)
 		{
-			for (int j = 0; j < sts.getCols(); j++)
+			int m = sts.wrapRow(row + c_neis[k].first);
+			int n = sts.wrapCol(col + c_neis[k].second);
+
+			int score2 = sts.score(m, n);
+			if (score > score2)
+				return StratTable::none;
+
+			if (score2 > maxScore)
 			{
-				sts(i, j)->totalScore = 0;
-				sts(i, j)->score = 0;
+				maxScore = score2;
+				bestType = sts.type(m, n);
+			}
+		}
+
+		return bestType;
+	}
+
+	// A fresh genome in genome maps, otherwise one of the built-in types
+	TypeId NzgNode::randomType()
+	{
+		if (m_mapType == MapType::genomes)
+			return strats.intern(Genome(std::min(std::max(genomeMemory, 1), (int)Genome::maxMemory), m_rng.next()));
+
+		const int nTypes = sizeof(c_mutants) / sizeof(c_mutants[0]);
+		return (TypeId)c_mutants[m_rng.below(nTypes)];
+	}
+
+	// The type a cell gets when it imitates id: a copy, for genomes with a chance of an error
+	TypeId NzgNode::imitate(TypeId id)
+	{
+		if (genomeMutation > 0 && strats.isGenome(id) && m_rng.uniform() < genomeMutation)
+			return strats.mutate(id, m_rng);
+		return id;
+	}
+
+	// Single-cell decision of the current rule, used by the asynchronous schedules
+	TypeId NzgNode::decide(int row, int col)
+	{
+		if (mutation > 0 && m_rng.uniform() < mutation)
+			return randomType();
+
+		if (rule == Rule::best)
+		{
+			TypeId nt = decideBest(row, col);
+			return nt == StratTable::none ? nt : imitate(nt);
+		}
+
+		int k = (int)m_rng.below(8);
+		int m = sts.wrapRow(row + c_neis[k].first);
+		int n = sts.wrapCol(col + c_neis[k].second);
+		float dp = (float)(sts.score(m, n) - sts.score(row, col));
+		float prob = 0;
+		imitationProbs(&dp, &prob, 1);
+		if (m_rng.uniform() < prob)
+			return imitate(sts.type(m, n));
+
+		return StratTable::none;
+	}
+
+	// Probabilities to imitate a neighbour that scored dp[i] more than the cell
+	void NzgNode::imitationProbs(const float* dp, float* prob, int n) const
+	{
+		if (rule == Rule::fermi)
+		{
+			float invK = fermiK > 0 ? (float)(1.0 / fermiK) : 1e30f;
+			for (int i = 0; i < n; i++)
+			{
+				prob[i] = 1.0f / (1.0f + expApprox(-dp[i] * invK));
+			}
+		}
+		else
+		{
+			for (int i = 0; i < n; i++)
+			{
+				prob[i] = std::max(dp[i], 0.0f) * (1.0f / c_maxScoreDiff);
+			}
+		}
+	}
+
+	// Synchronous decisions of one row for the stochastic rules. Neighbour choices,
+	// score differences, probabilities and random numbers are each produced for the
+	// whole row in a separate tight loop, so the exp and RNG work is vectorised.
+	void NzgNode::decideRow(const int* const* pScores, const TypeId* const* pTypes, TypeId* newSts, Worker& w)
+	{
+		int cols = sts.getCols();
+		w.nei.resize(cols);
+		w.src.resize(cols);
+		w.dp.resize(cols);
+		w.prob.resize(cols);
+		w.u.resize(cols);
+
+		w.rng.fillBits(w.nei.data(), cols, 3);
+		for (int j = 0; j < cols; j++)
+		{
+			int k = w.nei[j];
+			int m = c_neis[k].first + 1;
+			int n = sts.wrapCol(j + c_neis[k].second);
+			w.src[j] = m * cols + n;
+			w.dp[j] = (float)(pScores[m][n] - pScores[1][j]);
+		}
+
+		imitationProbs(w.dp.data(), w.prob.data(), cols);
+
+		w.rng.fill(w.u.data(), cols);
+		for (int j = 0; j < cols; j++)
+		{
+			int nSrc = w.src[j];
+			newSts[j] = w.u[j] < w.prob[j] ? pTypes[nSrc / cols][nSrc % cols] : (TypeId)StratTable::none;
+		}
+	}
+
+	// Row version of decideBest on the score and type rows above, at and below the row
+	void NzgNode::decideBestRow(const int* const* pScores, const TypeId* const* pTypes, TypeId* newSts) const
+	{
+		for (int j = 0; j < sts.getCols(); j++)
+		{
+			int score = pScores[1][j];
+			int maxScore = 0;
+			TypeId bestType = StratTable::none;
+			for (int k = 0; k < 8; k++)
+			{
+				int m = c_neis[k].first + 1;
+				int n = sts.wrapCol(j + c_neis[k].second);
+
+				int score2 = pScores[m][n];
+				if (score > score2)
+				{
+					bestType = StratTable::none;
+					break;
+				}
+
+				if (score2 > maxScore)
+				{
+					maxScore = score2;
+					bestType = pTypes[m][n];
+				}
+			}
+			newSts[j] = bestType;
+		}
+	}
+
+	// Imitation errors and mutations of a row of decisions. If pTypes is given,
+	// cells keeping their type get it from there instead of StratTable::none.
+	void NzgNode::mutateRow(TypeId* newSts, const TypeId* pTypes, std::vector<float>& u)
+	{
+		int cols = sts.getCols();
+		if (genomeMutation > 0)
+		{
+			for (int j = 0; j < cols; j++)
+			{
+				if (newSts[j] != StratTable::none)
+					newSts[j] = imitate(newSts[j]);
+			}
+		}
+
+		if (mutation > 0)
+		{
+			u.resize(cols);
+			m_rng.fill(u.data(), cols);
+			for (int j = 0; j < cols; j++)
+			{
+				if (u[j] < mutation)
+					newSts[j] = randomType();
+			}
+		}
+
+		if (pTypes != nullptr)
+		{
+			for (int j = 0; j < cols; j++)
+			{
+				if (newSts[j] == StratTable::none)
+					newSts[j] = pTypes[j];
 			}
 		}
 	}
 
 	void NzgNode::updateStrat()
 	{
-		std::map<std::pair<int, int>, Strat::Type> newSts;
-		std::pair<int, int> neis[8] = { {-1, -1}, {-1, 0}, {-1, 1}, {0, 1}, {1, 1}, {1, 0}, {1, -1}, {0, -1} };
-		for (int i = 0; i < sts.getRows(); i++)
+		NZG_PROF_SCOPE("NzgNode::updateStrat");
+		updateScores();
+		if (schedule == Schedule::synchronous)
+			updateStratSync();
+		else
+			updateStratAsync();
+	}
+
+	// Decisions are taken from the old map by rows in parallel, into the second type plane. Imitation errors and
+	// mutations may intern new genomes, so they follow in a serial pass before the
+	// decisions are applied.
+	void NzgNode::updateStratSync()
+	{
+		prepareWorkers();
+		m_nPassSeed = m_rng.next();
+
+		int cols = sts.getCols();
+		forBands([&](int row0, int row1, int thread) {
+			for (int i = row0; i < row1; i++)
+			{
+				sts.streamRow(i, row0, row1);
+				int up = sts.wrapRow(i - 1);
+				int down = sts.wrapRow(i + 1);
+				const int* pScores[3] = { sts.getScoreRow(up), sts.getScoreRow(i), sts.getScoreRow(down) };
+				const TypeId* pTypes[3] = { sts.getTypeRow(up), sts.getTypeRow(i), sts.getTypeRow(down) };
+				TypeId* pRow = sts.getNextTypeRow(i);
+				if (rule == Rule::best)
+				{
+					decideBestRow(pScores, pTypes, pRow);
+				}
+				else
+				{
+					seedStream(m_workers[thread], 2 * (uint64_t)i + 1);
+					decideRow(pScores, pTypes, pRow, m_workers[thread]);
+				}
+			}
+		});
+
+		if (genomeMutation > 0 || mutation > 0)
 		{
-			for (int j = 0; j < sts.getCols(); j++)
+			for (int i = 0; i < sts.getRows(); i++)
+				mutateRow(sts.getNextTypeRow(i), nullptr, m_workers[0].u);
+		}
+
+		forBands([&](int row0, int row1, int) {
+			int nChanged = 0;
+			std::vector<int64_t> changes;
+			for (int i = row0; i < row1; i++)
 			{
-				Strat* ps1 = sts(i, j).get();
-				bool updateStr = true;
-				int maxScore = 0;
-				Strat::Type bestType = Strat::Type::maxType;
-				for (int k = 0; k < 8; k++)
+				sts.streamRow(i, row0, row1);
+				const TypeId* pNew = sts.getNextTypeRow(i);
+				TypeId* pRow = sts.getTypeRow(i);
+				for (int j = 0; j < cols; j++)
 				{
-					int m = i + neis[k].first;
-					int n = j + neis[k].second;
-
-					if (m < 0)
-						m += sts.getRows();
-					if (m >= sts.getRows())
-						m -= sts.getRows();
-					if (n < 0)
-						n += sts.getCols();
-					if (n >= sts.getCols())
-						n -= sts.getCols();
-
-					Strat* ps2 = sts(m, n).get();
-					if (ps1->totalScore > ps2->totalScore)
-					{
-						updateStr = false;
-						break;
-					}
+					TypeId nt = pNew[j];
+					if (nt == StratTable::none || nt == pRow[j])
+						continue;
+
+					pRow[j] = nt;
+					nChanged++;
+					if (trackChanges)
+						changes.push_back((int64_t)i * cols + j);
+				}
+			}
+			NZG_PROF_COUNT(Profiler::cntCellsChanged, nChanged);
+			addChanges(changes);
+		});
+
+		m_bScored = false;
+		collectTypes();
+	}
+
+	// Single-cell update. Returns true if the cell changed its type, in which case
+	// the scores of the cell and of its neighbours are brought up to date.
+	bool NzgNode::updateCell(int row, int col)
+	{
+		TypeId nt = decide(row, col);
+		if (nt == StratTable::none || nt == sts.type(row, col))
+			return false;
+
+		sts.type(row, col) = nt;
+		NZG_PROF_COUNT(Profiler::cntCellsChanged, 1);
+		addChange((int64_t)row * sts.getCols() + col);
+		rescoreRing(row, col);
+		return true;
+	}
+
+	// One sweep of rows*cols single-cell updates. Only the games of a cell that
+	// flipped are replayed, so a sweep costs O(rows*cols) instead of O((rows*cols)^2).
+	void NzgNode::updateStratAsync()
+	{
+		prepareWorkers();
+		m_nPassSeed = m_rng.next();
+		seedStream(m_workers[0], 0);
+
+		int rows = sts.getRows();
+		int cols = sts.getCols();
+		int64_t nCells = (int64_t)rows * cols;
+		if (nCells == 0)
+			return;
+
+		if (schedule == Schedule::randomSequential)
+		{
+			for (int64_t i = 0; i < nCells; i++)
+			{
+				int64_t nCell = (int64_t)m_rng.below64(nCells);
+				updateCell((int)(nCell / cols), (int)(nCell % cols));
+			}
+		}
+		else
+		{
+			if ((int64_t)m_order.size() != nCells)
+			{
+				m_order.resize(nCells);
+				for (int64_t i = 0; i < nCells; i++)
+					m_order[i] = i;
+			}
+
+			// Fisher-Yates shuffle of the previous order gives a fresh uniform permutation
+			for (int64_t i = nCells - 1; i > 0; i--)
+			{
+				int64_t j = (int64_t)m_rng.below64(i + 1);
+				std::swap(m_order[i], m_order[j]);
+			}
+
+			for (int64_t i = 0; i < nCells; i++)
+			{
+				int64_t nCell = m_order[i];
+				updateCell((int)(nCell / cols), (int)(nCell % cols));
+			}
+		}
+
+		collectTypes();
+	}
+
+	// Recompute the total score of one cell from the 16 games it takes part in:
+	// 8 it starts against its neighbours and 8 its neighbours start against it.
+	void NzgNode::rescore(int row, int col)
+	{
+		NZG_PROF_COUNT(Profiler::cntGames, 16);
+		TypeId t1 = sts.type(row, col);
+		int total = 0;
+		for (int k = 0; k < 8; k++)
+		{
+			int m = sts.wrapRow(row + c_neis[k].first);
+			int n = sts.wrapCol(col + c_neis[k].second);
+			TypeId t2 = sts.type(m, n);
+
+			int s1 = 0;
+			int s2 = 0;
+			match(t1, t2, s1, s2, m_workers[0]);
+			total += s1;
+			match(t2, t1, s1, s2, m_workers[0]);
+			total += s2;
+		}
+		sts.score(row, col) = total;
+	}
+
+	// Rescore the cell and its 8 neighbours, the only scores touched by a change of its type
+	void NzgNode::rescoreRing(int row, int col)
+	{
+		rescore(row, col);
+		for (int k = 0; k < 8; k++)
+		{
+			rescore(sts.wrapRow(row + c_neis[k].first), sts.wrapCol(col + c_neis[k].second));
+		}
+	}
+
+	void NzgNode::editCells(const std::vector<CellEdit>& edits)
+	{
+		NZG_PROF_SCOPE("NzgNode::editCells");
+		int rows = sts.getRows();
+		int cols = sts.getCols();
+		for (const CellEdit& e : edits)
+		{
+			if (e.row < 0 || e.row >= rows || e.col < 0 || e.col >= cols)
+				throw std::out_of_range("Cell outside the map");
+			if (!strats.isValid(e.type))
+				throw std::invalid_argument("Unknown type id");
+		}
+
+		m_dirty.clear();
+		for (const CellEdit& e : edits)
+		{
+			TypeId& t = sts.type(e.row, e.col);
+			if (t == e.type)
+				continue;
+			t = e.type;
+			NZG_PROF_COUNT(Profiler::cntCellsChanged, 1);
+			addChange((int64_t)e.row * cols + e.col);
+			if (!m_bScored)
+				continue;
+
+			m_dirty.push_back((int64_t)e.row * cols + e.col);
+			for (int k = 0; k < 8; k++)
+			{
+				int m = sts.wrapRow(e.row + c_neis[k].first);
+				int n = sts.wrapCol(e.col + c_neis[k].second);
+				m_dirty.push_back((int64_t)m * cols + n);
+			}
+		}
+		if (m_dirty.empty())
+			return;
+
+		// A rescore plays 16 games and play() 8 per cell in parallel, big strokes replay all
+		if ((int64_t)m_dirty.size() > sts.getSize())
+		{
+			resetTotalScores();
+			play();
+			return;
+		}
 
-					if (ps2->totalScore > maxScore)
+		// Rings of neighbouring edits overlap, most of a brush stroke is rescored 9 times otherwise
+		std::sort(m_dirty.begin(), m_dirty.end());
+		m_dirty.erase(std::unique(m_dirty.begin(), m_dirty.end()), m_dirty.end());
+
+		prepareWorkers();
+		m_nPassSeed = m_rng.next();
+		seedStream(m_workers[0], 0);
+		for (int64_t nCell : m_dirty)
+			rescore((int)(nCell / cols), (int)(nCell % cols));
+	}
+
+	void NzgNode::setCell(int row, int col, TypeId type)
+	{
+		editCells({ { row, col, type } });
+	}
+
+	void NzgNode::paint(int row, int col, int radius, TypeId type)
+	{
+		int rows = sts.getRows();
+		int cols = sts.getCols();
+		if (rows == 0 || cols == 0)
+			return;
+		if (radius < 0)
+			throw std::invalid_argument("Negative radius");
+
+		// A brush wider than the map wraps onto cells it already has; the offsets nearest
+		// to the centre of each row and column cover the others, so only these are kept
+		// and a stroke is at most the map
+		radius = std::min(radius, rows + cols);
+		m_edits.clear();
+		for (int i = std::max(-radius, -(rows - 1) / 2); i <= std::min(radius, rows / 2); i++)
+		{
+			int half = (int)std::sqrt((double)radius * radius - (double)i * i);
+			for (int j = std::max(-half, -(cols - 1) / 2); j <= std::min(half, cols / 2); j++)
+				m_edits.push_back({ ((row + i) % rows + rows) % rows, ((col + j) % cols + cols) % cols, type });
+		}
+		editCells(m_edits);
+	}
+
+	void NzgNode::step()
+	{
+		if (schedule == Schedule::synchronous)
+		{
+			updateStrat();
+			resetTotalScores();
+			play();
+		}
+		else
+		{
+			// Asynchronous updates keep the scores current by themselves
+			updateStrat();
+		}
+		m_nGeneration++;
+	}
+
+	// Synchronous generation without the score plane. The scores of row r are complete
+	// once rows r-1..r+1 have played, and the decisions of row r need the scores of rows
+	// r-1..r+1, so a band of rows streams with a window of 5 score rows, playing two rows
+	// ahead of the row it decides. Decisions go straight to the second type plane.
+	// Bands replay the 2 rows on either side, so they need no synchronisation; a
+	// stochastic game across a band edge is then sampled separately for the two sides.
+	void NzgNode::stepFused()
+	{
+		NZG_PROF_SCOPE("NzgNode::stepFused");
+		prepareWorkers();
+		strats.reserveCache();
+		m_nPassSeed = m_rng.next();
+
+		bool bResolve = genomeMutation == 0;
+		forBands([&](int row0, int row1, int thread) {
+			stepRows(row0, row1, bResolve, m_workers[thread]);
+		});
+
+		if (genomeMutation > 0 || mutation > 0)
+		{
+			for (int i = 0; i < sts.getRows(); i++)
+				mutateRow(sts.getNextTypeRow(i), sts.getTypeRow(i), m_workers[0].u);
+		}
+
+		if (trackChanges && !m_bChangesLost)
+		{
+			int cols = sts.getCols();
+			forBands([&](int row0, int row1, int) {
+				std::vector<int64_t> changes;
+				for (int i = row0; i < row1; i++)
+				{
+					sts.streamRow(i, row0, row1);
+					const TypeId* pNew = sts.getNextTypeRow(i);
+					const TypeId* pRow = sts.getTypeRow(i);
+					for (int j = 0; j < cols; j++)
 					{
-						maxScore = ps2->totalScore;
-						bestType = ps2->type;
+						if (pNew[j] != pRow[j])
+							changes.push_back((int64_t)i * cols + j);
 					}
 				}
+				addChanges(changes);
+			});
+		}
+
+		sts.swapTypes();
+		m_bScored = false;
+		m_nGeneration++;
+		collectTypes();
+	}
+
+	void NzgNode::stepRows(int row0, int row1, bool bResolve, Worker& w)
+	{
+		const int nRing = 5;
+		int cols = sts.getCols();
+		w.ring.resize(nRing * cols);
+		auto ringRow = [&](int row) {
+			return w.ring.data() + (row - row0 + 3) % nRing * cols;
+		};
+		std::fill(ringRow(row0 - 3), ringRow(row0 - 3) + cols, 0);
+		std::fill(ringRow(row0 - 2), ringRow(row0 - 2) + cols, 0);
+
+		int64_t nGames = 0;
+		int nChanged = 0;
+		for (int r = row0 - 2; r <= row1 + 1; r++)
+		{
+			sts.streamRow(r, row0, row1);
+
+			// Play the games row r starts, with the draws a band replaying the row gets too
+			seedStream(w, 2 * (uint64_t)sts.wrapRow(r));
+			int* pScores[3] = { ringRow(r - 1), ringRow(r), ringRow(r + 1) };
+			std::fill(pScores[2], pScores[2] + cols, 0);
+			const TypeId* pTypes[3] = {
+				sts.getTypeRow(sts.wrapRow(sts.wrapRow(r) - 1)),
+				sts.getTypeRow(sts.wrapRow(r)),
+				sts.getTypeRow(sts.wrapRow(sts.wrapRow(r) + 1))
+			};
+			for (int j = 0; j < cols; j++)
+			{
+				TypeId t1 = pTypes[1][j];
+				for (int k = 0; k < 8; k++)
+				{
+					int m = c_neis[k].first + 1;
+					int n = sts.wrapCol(j + c_neis[k].second);
+
+					int s1 = 0;
+					int s2 = 0;
+					match(t1, pTypes[m][n], s1, s2, w);
+					pScores[1][j] += s1;
+					pScores[m][n] += s2;
+				}
+			}
+			nGames += 8 * cols;
 
-				newSts[std::pair<int, int>(i, j)] = updateStr ? bestType : Strat::Type::maxType;
+			// The scores of rows d-1..d+1 are complete now
+			int d = r - 2;
+			if (d < row0)
+				continue;
 
+			const int* pDecScores[3] = { ringRow(d - 1), ringRow(d), ringRow(d + 1) };
+			const TypeId* pDecTypes[3] = {
+				sts.getTypeRow(sts.wrapRow(d - 1)),
+				sts.getTypeRow(d),
+				sts.getTypeRow(sts.wrapRow(d + 1))
+			};
+			TypeId* pNew = sts.getNextTypeRow(d);
+			if (rule == Rule::best)
+			{
+				decideBestRow(pDecScores, pDecTypes, pNew);
+			}
+			else
+			{
+				seedStream(w, 2 * (uint64_t)d + 1);
+				decideRow(pDecScores, pDecTypes, pNew, w);
+			}
+
+			for (int j = 0; j < cols; j++)
+			{
+				if (pNew[j] == StratTable::none)
+				{
+					if (bResolve)
+						pNew[j] = pDecTypes[1][j];
+				}
+				else if (pNew[j] != pDecTypes[1][j])
+				{
+					nChanged++;
+				}
 			}
 		}
+		NZG_PROF_COUNT(Profiler::cntGames, nGames);
+		NZG_PROF_COUNT(Profiler::cntCellsChanged, nChanged);
+	}
 
-		for (int i = 0; i < sts.getRows(); i++)
+	void NzgNode::run(int nSteps)
+	{
+		if (schedule != Schedule::synchronous || !fused || sts.getRows() < 3)
 		{
-			for (int j = 0; j < sts.getCols(); j++)
+			for (int i = 0; i < nSteps; i++)
+				step();
+			return;
+		}
+
+		// With the scores at hand the decisions alone are cheaper than the fused kernel
+		// replaying the games; the scores at the end are left to the readers
+		for (int i = 0; i < nSteps; i++)
+		{
+			if (m_bScored)
+			{
+				updateStratSync();
+				m_nGeneration++;
+			}
+			else
 			{
-				if (newSts[{i, j}] == Strat::Type::maxType)
-					continue;
+				stepFused();
+			}
+		}
+	}
 
-				sts(i, j)->type = newSts[{i, j}];
+	Generator<GenView> NzgNode::generations(int every, int64_t nCount)
+	{
+		for (int64_t k = 0; nCount < 0 || k < nCount; k++)
+		{
+			run(std::max(every, 1));
+			updateScores();
+			GenView view = getView();
+			co_yield view;
+		}
+	}
+
+	GenView NzgNode::getView() const
+	{
+		GenView view;
+		view.generation = m_nGeneration;
+		view.rows = sts.getRows();
+		view.cols = sts.getCols();
+		view.types = sts.getTypes();
+		view.scores = sts.getScores();
+		view.strats = &strats;
+		return view;
+	}
+
+	bool NzgNode::takeChanges(std::vector<int64_t>& cells)
+	{
+		std::lock_guard<std::mutex> lock(m_changesMutex);
+		cells.clear();
+		cells.swap(m_changes);
+		bool bComplete = !m_bChangesLost;
+		m_bChangesLost = false;
+		return bComplete;
+	}
+
+	void NzgNode::addChanges(const std::vector<int64_t>& cells)
+	{
+		if (cells.empty())
+			return;
+		std::lock_guard<std::mutex> lock(m_changesMutex);
+		if (m_bChangesLost)
+			return;
+		if ((int64_t)(m_changes.size() + cells.size()) > getMaxChanges())
+			loseChanges();
+		else
+			m_changes.insert(m_changes.end(), cells.begin(), cells.end());
+	}
+
+	void NzgNode::loseChanges()
+	{
+		m_bChangesLost = true;
+		std::vector<int64_t>().swap(m_changes);
+	}
+
+	void NzgNode::serialize(Archive& ar)
+	{
+		Node::serialize(ar);
+
+		DWORD dwVer = 1;
+		uint64_t state[4];
+		if (ar.isStoring())
+		{
+			ar << dwVer;
+			ar.write(&schedule, sizeof(schedule));
+			ar.write(&rule, sizeof(rule));
+			ar << fermiK;
+			ar << mutation;
+			ar << genomeMemory;
+			ar << genomePool;
+			ar << genomeMutation;
+			ar << noise;
+			ar << fused;
+			ar.write(&m_mapType, sizeof(m_mapType));
+			ar.write(&m_nGeneration, sizeof(m_nGeneration));
+			m_rng.getState(state);
+			ar.write(state, sizeof(state));
+			strats.serialize(ar);
+
+			ar << sts.getRows();
+			ar << sts.getCols();
+			for (int i = 0; i < sts.getRows(); i++)
+			{
+				sts.streamRow(i, 0, sts.getRows());
+				ar.write(sts.getTypeRow(i), sts.getCols() * sizeof(TypeId));
 			}
 		}
+		else
+		{
+			// Everything is read into locals and checked first, the node only takes it at
+			// the end. The map can't wait that long, its old rows are gone once reading
+			// the new ones starts
+			Schedule newSchedule;
+			Rule newRule;
+			double newFermiK, newMutation, newGenomeMutation, newNoise;
+			int newGenomeMemory, newGenomePool;
+			bool newFused;
+			MapType newMapType;
+			int64_t nGeneration;
+			StratTable newStrats;
+			int rows, cols;
+			ar >> dwVer;
+			ar.read(&newSchedule, sizeof(newSchedule));
+			ar.read(&newRule, sizeof(newRule));
+			ar >> newFermiK;
+			ar >> newMutation;
+			ar >> newGenomeMemory;
+			ar >> newGenomePool;
+			ar >> newGenomeMutation;
+			ar >> newNoise;
+			ar >> newFused;
+			ar.read(&newMapType, sizeof(newMapType));
+			ar.read(&nGeneration, sizeof(nGeneration));
+			ar.read(state, sizeof(state));
+			if ((int)newSchedule < 0 || newSchedule >= Schedule::maxSchedule)
+				throw std::runtime_error("Bad schedule in archive");
+			if ((int)newRule < 0 || newRule >= Rule::maxRule)
+				throw std::runtime_error("Bad rule in archive");
+			if ((int)newMapType < 0 || newMapType > MapType::bitmap)
+				throw std::runtime_error("Bad map type in archive");
+			if (newGenomeMemory < 1 || newGenomeMemory > Genome::maxMemory || newGenomePool < 0)
+				throw std::runtime_error("Bad genome parameters in archive");
+			newStrats.serialize(ar);
+
+			ar >> rows;
+			ar >> cols;
+			if (rows < 0 || cols < 0)
+				throw std::runtime_error("Bad map size in archive");
+			allocateMap(rows, cols);
+			for (int i = 0; i < rows; i++)
+			{
+				sts.streamRow(i, 0, rows);
+				TypeId* pRow = sts.getTypeRow(i);
+				ar.read(pRow, cols * sizeof(TypeId));
+				for (int j = 0; j < cols; j++)
+				{
+					if (pRow[j] >= newStrats.getCount())
+						throw std::runtime_error("Bad type in archive");
+				}
+			}
+
+			schedule = newSchedule;
+			rule = newRule;
+			fermiK = newFermiK;
+			mutation = newMutation;
+			genomeMemory = newGenomeMemory;
+			genomePool = newGenomePool;
+			genomeMutation = newGenomeMutation;
+			noise = newNoise;
+			fused = newFused;
+			m_mapType = newMapType;
+			m_nGeneration = nGeneration;
+			m_rng.setState(state);
+			strats.swap(newStrats);
+			m_workers.clear();
+			m_bScored = false;
+		}
 	}
 
 	void NzgNode::reset(int rows, int cols, MapType mt)
@@ -318,6 +1539,48 @@ namespace nzg
 		setMap(mt, rows, cols);
 	}
 
+	size_t NzgNode::getMemorySize() const
+	{
+		size_t size = sts.getMemorySize() + strats.getMemorySize() +
+			m_order.capacity() * sizeof(int64_t) + m_counts.capacity() * sizeof(uint32_t);
+		for (const auto& w : m_workers)
+		{
+			size += w.nei.capacity() + (w.src.capacity() + w.dp.capacity() + w.prob.capacity() + w.u.capacity()) * 4;
+		}
+		return size;
+	}
+
+	void NzgNode::seed(uint64_t s)
+	{
+		m_rng.seed(s);
+		m_workers.clear();
+	}
+
+	// Brings the pool and the per thread state in line with threads and noise
+	void NzgNode::prepareWorkers()
+	{
+		m_pool.setAffinity(affinity);
+		m_pool.setThreads(threads);
+		m_workers.resize(m_pool.getThreads());
+		for (auto& w : m_workers)
+		{
+			if (w.noise.getRate() != noise)
+				w.noise.setRate(noise, w.rng);
+		}
+	}
+
+	void NzgNode::collectTypes()
+	{
+		if (strats.getGenomeCount() == 0)
+			return;
+
+		m_counts.assign(strats.getCount(), 0);
+		const TypeId* pTypes = sts.getTypes();
+		for (int64_t i = 0; i < sts.getSize(); i++)
+			m_counts[pTypes[i]]++;
+		strats.collect(m_counts);
+	}
+
 	// End of NzgNode implementation
 	////////////////////////////////////////////////////////////////////////////////////////////////////
 }
\ No newline at end of file
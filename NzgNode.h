@@ -1,9 +1,54 @@
 #pragma once
 
 #include "Node.h"
+#include "Random.h"
+#include "ThreadPool.h"
+#include "Profiler.h"
+#include "Numa.h"
+#include "Generator.h"
+
+#include <unordered_map>
 
 namespace nzg
 {
+	class MapGen;
+
+	// Index of an interned strategy in StratTable, the per-cell content of the type plane
+	typedef uint16_t TypeId;
+
+	// Genome - memory-n strategy: a lookup table of the next move over the last n joint moves.
+	// A joint move is 2 bits (my move << 1 | his move, 1 = cooperate), the latest one in
+	// the low bits of the state. Before the first round both players count as cooperating.
+	struct Genome
+	{
+		Genome() : n(0), table(0) {}
+		Genome(int n_, uint64_t table_) : n(n_), table(table_ & getMask(n_)) {}
+
+		enum { maxMemory = 3 };
+
+		int n;			// Memory 1..maxMemory
+		uint64_t table;	// Bit s is the move in state s
+
+		int getStates() const { return 1 << (2 * n); }
+		int getFirstState() const { return getStates() - 1; }
+		bool move(int state) const { return ((table >> state) & 1) != 0; }
+		int nextState(int state, bool my, bool his) const {
+			return ((state << 2) | (my ? 2 : 0) | (his ? 1 : 0)) & (getStates() - 1);
+		}
+		static uint64_t getMask(int n) {
+			return n >= maxMemory ? ~0ull : (1ull << (1 << (2 * n))) - 1;
+		}
+		std::string getName() const;
+
+		bool operator==(const Genome& a) const { return n == a.n && table == a.table; }
+		struct Hash
+		{
+			size_t operator()(const Genome& g) const {
+				return std::hash<uint64_t>()(g.table * 0x9E3779B97F4A7C15ull + g.n);
+			}
+		};
+	};
+
 	class Strat
 	{
 	public:
@@ -16,50 +61,250 @@ namespace nzg
 			graaskamp = 5,	// Same as joss but defects not 10% but 50th round
 			titfortat = 6,	// Optimal, starts coop, copy the last move of the opponent
 			random = 7,
-			maxType
+			genome = 8,		// Memory-n lookup table strategy
+			maxType = genome
 		};
 		static const char* c_types[(int)Type::maxType+1];
 		
 
 		Strat();
-		Strat(Type t) : type(t), score(0), totalScore(0) {}
+		Strat(Type t) : type(t) {}
+		Strat(const Genome& g) : type(Type::genome), genome(g) {}
 		virtual ~Strat();
 
 		// Attributes:
 	public:
 		Type type;
-		int score;
-		int totalScore;
+		Genome genome;
+
+		bool isGenome() const { return type == Type::genome; }
+		bool isDeterministic() const {
+			return type != Type::friedman && type != Type::random;
+		}
 
-		virtual bool play(std::vector<bool>& my, std::vector<bool>& his);
+		// Next move; friedman and random draw from rng, the generator of the calling thread
+		virtual bool play(std::vector<bool>& my, std::vector<bool>& his, Rng& rng);
 
 		DWORD getColor() const;
+		std::string getName() const;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////
+	// StratTable - interned strategies. Built-in types have TypeId == (int)Strat::Type,
+	// genomes get ids from Type::maxType on, identical genomes share one id.
+	// Match results of deterministic pairs are cached in a payoff table by id pair.
+	class StratTable
+	{
+	// Construction:
+	public:
+		StratTable();
+		~StratTable();
+		void reset();
+
+		enum : TypeId
+		{
+			none = 0xFFFF,			// No type / keep the current one
+			maxCached = 4096		// Ids with cached payoff rows
+		};
+
+	// Attributes:
+	public:
+		int getCount() const { return (int)m_strats.size(); }
+		int getGenomeCount() const { return getCount() - (int)Strat::Type::maxType - (int)m_free.size(); }
+		const Strat& get(TypeId id) const { return m_strats[id]; }
+		const std::vector<Strat>& getStrats() const { return m_strats; }
+		bool isGenome(TypeId id) const { return id >= (TypeId)Strat::Type::maxType; }
+		// An id of the table that is not released
+		bool isValid(TypeId id) const { return id < getCount() && (!isGenome(id) || m_strats[id].genome.n != 0); }
+		size_t getMemorySize() const;
+
+	// Operations:
+	public:
+		TypeId intern(const Genome& g); // Returns none if all ids are taken
+		TypeId mutate(TypeId id, Rng& rng); // Genome with one table bit flipped
+		void reserveCache(); // Make room in the payoff table for all current ids
+		void collect(const std::vector<uint32_t>& counts); // Release genomes no cell uses
+		void swap(StratTable& other);
+		void serialize(Archive& ar);
+
+		// Plays one match of 50 rounds, cached if both strategies are deterministic.
+		// Several threads may play at once between reserveCache() and the next intern(),
+		// each with its own rng.
+		void match(TypeId a, TypeId b, int& s1, int& s2, Rng& rng) {
+			if (a < m_cap && b < m_cap)
+			{
+				int16_t c1 = m_pay[a * m_cap + b].load(std::memory_order_relaxed);
+				int16_t c2 = m_pay[b * m_cap + a].load(std::memory_order_relaxed);
+				if (c1 >= 0 && c2 >= 0)
+				{
+					s1 = c1;
+					s2 = c2;
+					return;
+				}
+			}
+			matchSlow(a, b, s1, s2, rng);
+		}
+
+		// Match in which the moves set in flips1 (flips2) are flipped, bit p for round p
+		void match(TypeId a, TypeId b, int& s1, int& s2, Rng& rng, uint64_t flips1, uint64_t flips2) {
+			if ((flips1 | flips2) == 0)
+			{
+				match(a, b, s1, s2, rng);
+			}
+			else
+			{
+				NZG_PROF_COUNT(Profiler::cntSimulated, 1);
+				simulate(m_strats[a], m_strats[b], s1, s2, rng, flips1, flips2);
+			}
+		}
+
+		// Plays one match of the iterated game between two strategies; the flips cover
+		// the first 64 rounds
+		enum { c_rounds = 50 };
+		static void simulate(Strat& st1, Strat& st2, int& s1, int& s2, Rng& rng, uint64_t flips1 = 0, uint64_t flips2 = 0,
+			int nRounds = c_rounds);
+
+	// Implementation:
+	protected:
+		std::vector<Strat> m_strats;
+		std::unordered_map<Genome, TypeId, Genome::Hash> m_ids;
+		std::vector<TypeId> m_free; // Released genome ids, the lowest one last
+		int m_cap; // Row length of m_pay
+		std::vector<std::atomic<int16_t>> m_pay; // Score of a against b at [a * m_cap + b], -1 if unknown
+
+		void matchSlow(TypeId a, TypeId b, int& s1, int& s2, Rng& rng);
+		void growCache(int nMax);
+		void invalidate(TypeId id);
+	};
+	// End of StratTable
+	////////////////////////////////////////////////////////////////////////////////
+
+	////////////////////////////////////////////////////////////////////////////////
+	// MoveNoise - trembling hand: every move is flipped with probability eps.
+	// The number of moves between two errors is geometric, so it is drawn once per error
+	// instead of a random number per move, and a match without errors stays a table lookup.
+	class MoveNoise
+	{
+	// Construction:
+	public:
+		MoveNoise() : m_eps(0), m_logq(0), m_skip(INT64_MAX) {}
+		void setRate(double eps, Rng& rng);
+
+	// Attributes:
+	public:
+		double getRate() const { return m_eps; }
+
+	// Operations:
+	public:
+		// Flip masks of the moves of both players in the next match, false if there are none
+		bool draw(Rng& rng, uint64_t& flips1, uint64_t& flips2) {
+			if (m_skip >= 2 * c_rounds)
+			{
+				m_skip -= 2 * c_rounds;
+				return false;
+			}
+			return drawSlow(rng, flips1, flips2);
+		}
+
+	// Implementation:
+	protected:
+		enum { c_rounds = 50 };
+		double m_eps;
+		double m_logq; // log(1 - eps)
+		int64_t m_skip; // Error free moves left before the next error
+
+		bool drawSlow(Rng& rng, uint64_t& flips1, uint64_t& flips2);
+		int64_t nextSkip(Rng& rng) const;
 	};
+	// End of MoveNoise
+	////////////////////////////////////////////////////////////////////////////////
 
+	// StratMatrix - the grid as two planes: interned types and total scores
 	class StratMatrix
 	{
 	// Construction:
 	public:
 		StratMatrix();
 		~StratMatrix();
-		void resize(int rows_, int cols_);
+		// Zero planes of rows_ x cols_; Placement::firstTouch touches the rows with pPool
+		void resize(int rows_, int cols_, Numa::Placement placement = Numa::Placement::local, ThreadPool* pPool = nullptr);
+		// Zero planes of rows_ x cols_ in scratch files of the directory, for grids bigger than RAM
+		bool map(const std::string& dir, int rows_, int cols_);
 
 	// Operations:
 	public:
-		std::shared_ptr<Strat> operator()(int row, int col) const {
-			return sts[row * cols + col];
+		TypeId type(int row, int col) const {
+			return types[(size_t)row * cols + col];
+		}
+		TypeId& type(int row, int col) {
+			return types[(size_t)row * cols + col];
 		}
-		std::shared_ptr<Strat>& operator()(int row, int col){
-			return sts[row * cols + col];
+		int score(int row, int col) const {
+			return scores[(size_t)row * cols + col];
+		}
+		int& score(int row, int col) {
+			return scores[(size_t)row * cols + col];
 		}
 		int getRows() const { return rows; }
 		int getCols() const { return cols; }
+		int64_t getSize() const { return (int64_t)rows * cols; }
+		int wrapRow(int row) const {
+			return row < 0 ? row + rows : row >= rows ? row - rows : row;
+		}
+		int wrapCol(int col) const {
+			return col < 0 ? col + cols : col >= cols ? col - cols : col;
+		}
+		const TypeId* getTypes() const { return types.data(); }
+		const int* getScores() const { return scores.data(); }
+		const TypeId* getTypeRow(int row) const { return types.data() + (size_t)row * cols; }
+		TypeId* getTypeRow(int row) { return types.data() + (size_t)row * cols; }
+		const int* getScoreRow(int row) const { return scores.data() + (size_t)row * cols; }
+		int* getScoreRow(int row) { return scores.data() + (size_t)row * cols; }
+		size_t getMemorySize() const {
+			return types.getMemorySize() + nextTypes.getMemorySize() + scores.getMemorySize();
+		}
+
+		// Second type plane the fused generation writes to, swapped in when it is complete
+		TypeId* getNextTypeRow(int row) { return nextTypes.data() + (size_t)row * cols; }
+		void swapTypes() { types.swap(nextTypes); }
+
+		// Mapped planes are walked by tiles of whole rows, each thread going down a band
+		// row0..row1 of whole tiles. A kernel calls this on every row of its band; the
+		// first row prefetches its tile, and at the start of a tile the next tile of the
+		// band is prefetched and the one before the last is released. The first tile of
+		// a band is kept, the band above reads its top rows.
+		void streamRow(int row, int row0, int row1) const {
+			if (tileRows > 0 && row >= row0 && row < row1 && (row == row0 || row % tileRows == 0))
+				streamTiles(row, row0, row1);
+		}
+		bool isMapped() const { return types.isMapped(); }
+		int getTileRows() const { return tileRows; }
 
 	// Attributes:
 	protected:
 		int rows;
 		int cols;
-		std::vector<std::shared_ptr<Strat>> sts;
+		NumaPlane<TypeId> types;
+		NumaPlane<TypeId> nextTypes;
+		NumaPlane<int> scores;
+		int tileRows;	// Rows of a tile of the mapped planes, 0 in memory
+
+		void streamTiles(int row, int row0, int row1) const;
+	};
+
+	// GenView - read-only look at the planes of one generation. It points into the
+	// engine and is valid until the engine moves on.
+	struct GenView
+	{
+		int64_t generation;
+		int rows;
+		int cols;
+		const TypeId* types;
+		const int* scores;
+		const StratTable* strats;
+
+		TypeId type(int row, int col) const { return types[(size_t)row * cols + col]; }
+		int score(int row, int col) const { return scores[(size_t)row * cols + col]; }
 	};
 
 	////////////////////////////////////////////////////////////////////////////////
@@ -74,25 +319,188 @@ namespace nzg
 		enum class MapType
 		{
 			random = 0,
-			ordered = 1
+			ordered = 1,
+			genomes = 2,	// Random memory-n genomes drawn from a pool of genomePool
+			uniform = 3,	// MapGen patterns with their defaults, generated in parallel
+			voronoi = 4,
+			stripes = 5,
+			invader = 6,	// A single defector among tit for tat
+			bitmap = 7,		// A loaded picture, only from setMap(const MapGen&)
+			maxMapType = bitmap
+		};
+		static const char* c_mapTypes[(int)MapType::maxMapType + 1];
+
+		// Order in which cells revise their strategies
+		enum class Schedule
+		{
+			synchronous = 0,		// All cells at once from the same scores
+			randomSequential = 1,	// rows*cols single updates of uniformly drawn cells
+			randomOrder = 2,		// Every cell once per sweep in a shuffled order
+			maxSchedule
 		};
+		static const char* c_schedules[(int)Schedule::maxSchedule];
+
+		// Rule by which a cell revises its strategy
+		enum class Rule
+		{
+			best = 0,			// Imitate the best neighbour unless better than all of them
+			fermi = 1,			// Imitate a random neighbour with probability 1/(1+exp(-(Pj-Pi)/K))
+			proportional = 2,	// Imitate a random better neighbour with probability (Pj-Pi)/maxDiff
+			maxRule
+		};
+		static const char* c_rules[(int)Rule::maxRule];
 
 	// Attributes:
 	public:
 		StratMatrix sts;
+		Schedule schedule;
+		Rule rule;
+		double fermiK;		// Selection noise K of Rule::fermi, in units of total score
+		double mutation;	// Probability to switch to a uniformly drawn type instead of updating
+		StratTable strats;	// Types of the cells in sts
+		int genomeMemory;	// Memory n of the genomes of MapType::genomes
+		int genomePool;		// Number of distinct genomes MapType::genomes starts with
+		double genomeMutation; // Probability that an imitated genome is copied with one bit flipped
+		double noise;		// Probability that a move comes out opposite to the intended one
+		int threads;		// Threads of play and updateStrat, 0 for all hardware threads
+		bool fused;			// run() does synchronous generations with the fused kernel
+		Numa::Placement placement; // Page placement of the planes, applied by setMap
+		bool affinity;		// Pin the pool threads to the NUMA nodes and give each the same rows every time
+		std::string storage; // Directory of the plane files of grids bigger than RAM, empty to keep them in memory
+		bool trackChanges;	// Record the cells that take a new type, for takeChanges()
+
+		size_t getMemorySize() const; // Bytes held by the engine
+		MapType getMapType() const { return m_mapType; }
+		int64_t getGeneration() const { return m_nGeneration; } // Generations since setMap
+		bool isScored() const { return m_bScored; }
+		GenView getView() const;
+		// Cells (row * cols + col, possibly repeated) that took a new type since the last
+		// call. False if the record gave out, on a new map or past an eighth of the cells,
+		// and every cell must count as changed.
+		bool takeChanges(std::vector<int64_t>& cells);
 
 	// Operations:
 	public:
 		void setMap(MapType mt, int rows, int cols);
+		void setMap(const MapGen& gen, int rows, int cols);
 
 		void play();
 		void resetTotalScores();
+		void updateScores(); // Replays the scores if the map changed since they were played
 		void updateStrat();
+		void step(); // One generation according to the schedule
+		void stepFused(); // One synchronous generation by the fused kernel, leaves the scores stale
+		// nSteps generations. The fused kernel leaves the scores stale, readers of the score
+		// plane call updateScores() first; generations() does.
+		void run(int nSteps);
+		// Views of every every-th generation from now on, with their scores, nCount of them
+		// or endless for -1.
+		// The engine runs only while the consumer asks for the next view, and the node
+		// must not be touched otherwise in between.
+		Generator<GenView> generations(int every = 1, int64_t nCount = -1);
 		void reset(int rows, int cols, MapType mt);
+		void collectTypes(); // Release genomes no cell holds any longer
+		void seed(uint64_t s); // Restart the random streams of the engine, for repeatable runs
+
+		// Cell edits, for painting strategies into the map. Valid scores stay valid: a type
+		// enters only the scores of its cell and the 8 neighbours, so just these are
+		// rescored, once each however many edits touch them. The next decisions reach
+		// the 2-ring, but they read the scores and need nothing recomputed.
+		struct CellEdit
+		{
+			int row;
+			int col;
+			TypeId type;
+		};
+		void editCells(const std::vector<CellEdit>& edits);
+		void setCell(int row, int col, TypeId type);
+		void paint(int row, int col, int radius, TypeId type); // Disc of cells around (row, col), wrapping
 
 	// Overrides:
 	public:
 		virtual std::string getName() const { return "Nzg"; }
+		// Checkpoint of the map, the strategies, the parameters and the random stream.
+		// A loaded run goes on like one restarted with seed(): repeatably, but not in
+		// step with the run that stored it, as it replays the scores first.
+		virtual void serialize(Archive& ar);
+
+	// Implementation:
+	protected:
+		static const std::pair<int, int> c_neis[8];
+		Rng m_rng;
+		MapType m_mapType;
+		std::vector<uint32_t> m_counts; // Cells per type id, for collectTypes
+		std::vector<int64_t> m_order; // Sweep order for Schedule::randomOrder
+		bool m_bScored; // Total scores are consistent with the current map
+		uint64_t m_nPassSeed; // Of the per row streams of the current pass, drawn from m_rng
+		int64_t m_nGeneration;
+		std::vector<CellEdit> m_edits; // Cells of paint()
+		std::vector<int64_t> m_dirty; // Cells to rescore after edits
+		std::vector<int64_t> m_changes; // Record of trackChanges
+		bool m_bChangesLost;
+		std::mutex m_changesMutex;
+
+		// Per thread state of the parallel loops, m_workers[0] serves the serial ones too.
+		// The streams are restarted per row (seedStream), so the draws don't depend on the
+		// number of threads or on which thread takes a row.
+		struct Worker
+		{
+			Rng rng;
+			MoveNoise noise;
+
+			// Row buffers of the vectorised stochastic rules
+			std::vector<uint8_t> nei;
+			std::vector<int> src;
+			std::vector<float> dp;
+			std::vector<float> prob;
+			std::vector<float> u;
 
+			std::vector<int> ring; // Score rows of the fused kernel
+		};
+		ThreadPool m_pool;
+		std::vector<Worker> m_workers;
+
+		void match(TypeId a, TypeId b, int& s1, int& s2, Worker& w) {
+			uint64_t f1, f2;
+			if (noise > 0 && w.noise.draw(w.rng, f1, f2))
+				strats.match(a, b, s1, s2, w.rng, f1, f2);
+			else
+				strats.match(a, b, s1, s2, w.rng);
+		}
+		void allocateMap(int rows, int cols);
+		void prepareWorkers();
+		// parallelFor over the rows in bands of whole tiles of the mapped planes
+		void forBands(const std::function<void(int, int, int)>& fn);
+		void seedStream(Worker& w, uint64_t nStream) {
+			w.rng.seed(m_nPassSeed, nStream);
+			if (noise > 0)
+				w.noise.setRate(noise, w.rng);
+		}
+		void playRows(int row0, int row1, Worker& w);
+		void stepRows(int row0, int row1, bool bResolve, Worker& w);
+		void decideBestRow(const int* const* pScores, const TypeId* const* pTypes, TypeId* newSts) const;
+		TypeId decide(int row, int col);
+		TypeId decideBest(int row, int col) const;
+		TypeId randomType();
+		TypeId imitate(TypeId id);
+		void decideRow(const int* const* pScores, const TypeId* const* pTypes, TypeId* newSts, Worker& w);
+		void mutateRow(TypeId* newSts, const TypeId* pTypes, std::vector<float>& u);
+		void imitationProbs(const float* dp, float* prob, int n) const;
+		bool updateCell(int row, int col);
+		void updateStratSync();
+		void updateStratAsync();
+		void rescore(int row, int col);
+		void rescoreRing(int row, int col);
+		void addChanges(const std::vector<int64_t>& cells); // From any thread
+		void addChange(int64_t cell) { // Serial code only
+			if (trackChanges && !m_bChangesLost)
+			{
+				m_changes.push_back(cell);
+				if ((int64_t)m_changes.size() > getMaxChanges())
+					loseChanges();
+			}
+		}
+		int64_t getMaxChanges() const { return std::max(sts.getSize() / 8, (int64_t)1024); }
+		void loseChanges();
 	};
 }
\ No newline at end of file
@@ -0,0 +1,374 @@
+// NzgRun.cpp - headless simulation runner.
+//
+//   NzgRun [--rows N] [--cols N] [--map random|ordered|genomes|uniform|voronoi|stripes|invader]
+//          [--sites N] [--bitmap map.bmp] [--steps N]
+//          [--schedule sync|sequential|order] [--rule best|fermi|proportional]
+//          [--threads N] [--seed S] [--noise eps] [--mutation p] [--trace trace.json]
+//          [--numa local|first-touch|interleave] [--storage dir] [--memory N] [--predict T]
+//          [--frames frame%06lld.png] [--frame-format png|ppm] [--frame-block N] [--frame-tables 0|1]
+//          [--correlation out.csv] [--correlation-every K]
+//   NzgRun --tournament N [--memory N] [--rounds N] [--repeats N] [--threads N] [--seed S]
+//
+// Prints the type counts after the run and, in NZG_PROFILE builds, the profiler summary.
+// --trace writes the timed scopes as a Chrome trace. --numa sets the page placement of
+// the planes and pins the pool to the NUMA nodes unless it is local. --bitmap scales a
+// picture painted in the type colours to the grid, --sites sets the clusters of voronoi.
+// --storage keeps the planes in scratch files of the directory, for grids bigger than RAM;
+// use the synchronous schedule with them, the others jump around the grid.
+// --tournament plays a round robin of the built-in types and N random memory-n genomes
+// instead and prints the ranking. --predict prints the shares the replicator equation
+// of a well mixed population predicts for the types of the map up to time T.
+// --frames writes an image of every generation, named by the pattern with the
+// generation for its %d (%06lld, ...); --frame-block shrinks the images by blocks of
+// N x N cells. --frame-tables 1 saves the summed-area tables of every frame next to it
+// (.sat), on the lines of the blocks, for region statistics over the run without the
+// cells. --correlation
+// writes the pair correlation g(r) and the structure factor S(k) of every type, averaged
+// over shells of |r| and |k|, every K generations as lines of
+// generation,type,count,g|S,value of shell 0,value of shell 1,...
+//
+#include "pch.h"
+
+#include "NzgNode.h"
+#include "MapGen.h"
+#include "Tournament.h"
+#include "Replicator.h"
+#include "FrameWriter.h"
+#include "Correlator.h"
+
+#include <chrono>
+
+namespace
+{
+	using nzg::NzgNode;
+
+	struct Settings
+	{
+		int rows;
+		int cols;
+		NzgNode::MapType map;
+		int steps;
+		NzgNode::Schedule schedule;
+		NzgNode::Rule rule;
+		int threads;
+		uint64_t seed;
+		double noise;
+		double mutation;
+		std::string trace;
+		nzg::Numa::Placement placement;
+		int sites;
+		std::string bitmap;
+		std::string storage;
+		int memory;
+		int tournament;	// Genomes of the tournament, -1 for the spatial game
+		int rounds;
+		int repeats;
+		double predict;	// Time of the mean field prediction, 0 for none
+		std::string frames;
+		nzg::FrameWriter::Format frameFormat;
+		int frameBlock;
+		bool frameTables;
+		std::string correlation;
+		int correlationEvery;
+
+		Settings() : rows(256), cols(256), map(NzgNode::MapType::random), steps(100),
+			schedule(NzgNode::Schedule::synchronous), rule(NzgNode::Rule::best), threads(0),
+			seed(1), noise(0), mutation(0), placement(nzg::Numa::Placement::firstTouch), sites(256),
+			memory(1), tournament(-1), rounds(nzg::StratTable::c_rounds), repeats(5), predict(0),
+			frameFormat(nzg::FrameWriter::Format::png), frameBlock(1), frameTables(false), correlationEvery(1) {
+		}
+	};
+
+	const char* c_schedules[] = { "sync", "sequential", "order" };
+	const char* c_rules[] = { "best", "fermi", "proportional" };
+
+	int findName(const std::string& name, const char* const* names, int nNames)
+	{
+		for (int i = 0; i < nNames; i++)
+		{
+			if (name == names[i])
+				return i;
+		}
+		return -1;
+	}
+
+	bool parse(int argc, char* argv[], Settings& s)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			std::string arg = argv[i];
+			if (i + 1 >= argc)
+				return false;
+			std::string val = argv[++i];
+
+			int n = 0;
+			if (arg == "--rows")
+				s.rows = std::stoi(val);
+			else if (arg == "--cols")
+				s.cols = std::stoi(val);
+			else if (arg == "--steps")
+				s.steps = std::stoi(val);
+			else if (arg == "--threads")
+				s.threads = std::stoi(val);
+			else if (arg == "--seed")
+				s.seed = std::stoull(val);
+			else if (arg == "--noise")
+				s.noise = std::stod(val);
+			else if (arg == "--mutation")
+				s.mutation = std::stod(val);
+			else if (arg == "--trace")
+				s.trace = val;
+			else if (arg == "--sites")
+				s.sites = std::stoi(val);
+			else if (arg == "--bitmap")
+				s.bitmap = val;
+			else if (arg == "--storage")
+				s.storage = val;
+			else if (arg == "--memory")
+				s.memory = std::stoi(val);
+			else if (arg == "--tournament")
+				s.tournament = std::stoi(val);
+			else if (arg == "--rounds")
+				s.rounds = std::stoi(val);
+			else if (arg == "--repeats")
+				s.repeats = std::stoi(val);
+			else if (arg == "--predict")
+				s.predict = std::stod(val);
+			else if (arg == "--frames")
+				s.frames = val;
+			else if (arg == "--frame-block")
+				s.frameBlock = std::stoi(val);
+			else if (arg == "--frame-tables")
+				s.frameTables = std::stoi(val) != 0;
+			else if (arg == "--correlation")
+				s.correlation = val;
+			else if (arg == "--correlation-every")
+				s.correlationEvery = std::stoi(val);
+			else if (arg == "--map" && (n = findName(val, NzgNode::c_mapTypes, (int)NzgNode::MapType::maxMapType)) >= 0)
+				s.map = (NzgNode::MapType)n;
+			else if (arg == "--schedule" && (n = findName(val, c_schedules, 3)) >= 0)
+				s.schedule = (NzgNode::Schedule)n;
+			else if (arg == "--rule" && (n = findName(val, c_rules, 3)) >= 0)
+				s.rule = (NzgNode::Rule)n;
+			else if (arg == "--numa" && (n = findName(val, nzg::Numa::c_placements, (int)nzg::Numa::Placement::maxPlacement)) >= 0)
+				s.placement = (nzg::Numa::Placement)n;
+			else if (arg == "--frame-format" && (n = findName(val, nzg::FrameWriter::c_formats, (int)nzg::FrameWriter::Format::maxFormat)) >= 0)
+				s.frameFormat = (nzg::FrameWriter::Format)n;
+			else
+				return false;
+		}
+		return s.rows > 0 && s.cols > 0 && s.rounds > 0 && s.repeats > 0 && s.frameBlock > 0 && s.correlationEvery > 0;
+	}
+
+	void printTypes(const NzgNode& node)
+	{
+		std::cout << "map: " << NzgNode::c_mapTypes[(int)node.getMapType()] << "\n";
+		std::vector<std::pair<int64_t, nzg::TypeId>> counts(node.strats.getCount());
+		for (size_t i = 0; i < counts.size(); i++)
+			counts[i] = std::make_pair((int64_t)0, (nzg::TypeId)i);
+		const nzg::TypeId* pTypes = node.sts.getTypes();
+		for (int64_t i = 0; i < node.sts.getSize(); i++)
+			counts[pTypes[i]].first--;
+		std::sort(counts.begin(), counts.end());
+
+		for (size_t i = 0; i < counts.size() && i < 20 && counts[i].first < 0; i++)
+			std::cout << node.strats.get(counts[i].second).getName() << ": " << -counts[i].first << "\n";
+	}
+
+	void printPrediction(NzgNode& node, double duration)
+	{
+		std::vector<bool> present(node.strats.getCount(), false);
+		const nzg::TypeId* pTypes = node.sts.getTypes();
+		for (int64_t i = 0; i < node.sts.getSize(); i++)
+			present[pTypes[i]] = true;
+		std::vector<nzg::TypeId> types;
+		for (size_t i = 0; i < present.size(); i++)
+		{
+			if (present[i])
+				types.push_back((nzg::TypeId)i);
+		}
+
+		nzg::Replicator rep;
+		rep.setPayoffs(node.strats, types);
+		rep.setShares(node);
+		if (!rep.run(duration, 10))
+			std::cerr << "The mean field prediction stopped at t = " << rep.getTime() << "\n";
+
+		std::cout << "t";
+		for (nzg::TypeId id : types)
+			std::cout << "\t" << node.strats.get(id).getName();
+		std::cout << "\n" << std::fixed;
+		for (int k = 0; k < rep.getSampleCount(); k++)
+		{
+			std::cout << std::setprecision(2) << rep.getSampleTime(k) << std::setprecision(4);
+			for (int i = 0; i < rep.getTypeCount(); i++)
+				std::cout << "\t" << rep.getSample(k)[i];
+			std::cout << "\n";
+		}
+		std::cout.unsetf(std::ios::floatfield);
+	}
+
+	void writeCorrelation(std::ostream& os, int64_t generation, const nzg::Correlator& cor)
+	{
+		for (const auto& curve : cor.getCurves())
+		{
+			for (int k = 0; k < 2; k++)
+			{
+				os << generation << "," << curve.name << "," << curve.count << (k == 0 ? ",g" : ",S");
+				for (double v : k == 0 ? curve.correlation : curve.structure)
+					os << "," << v;
+				os << "\n";
+			}
+		}
+	}
+
+	void runTournament(const Settings& s)
+	{
+		nzg::Tournament t;
+		t.rounds = s.rounds;
+		t.repeats = s.repeats;
+		t.threads = s.threads;
+		t.seed = s.seed;
+		t.addBuiltins();
+		t.addGenomes(s.tournament, s.memory, s.seed);
+
+		auto t0 = std::chrono::steady_clock::now();
+		t.run();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+		std::vector<int> ranking = t.getRanking();
+		for (size_t k = 0; k < ranking.size() && k < 20; k++)
+		{
+			int i = ranking[k];
+			std::cout << t.getEntrants()[i].rank + 1 << ". " << t.getName(i) << ": " << t.getEntrants()[i].score <<
+				" (" << std::fixed << std::setprecision(3) << t.getMeanScore(i) << " per round)\n";
+		}
+		std::cout << ranking.size() << " entrants, " << t.getSimulated() << " matches played in " <<
+			std::setprecision(2) << seconds << " s\n";
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	Settings s;
+	if (!parse(argc, argv, s))
+	{
+		std::cerr << "Usage: NzgRun [--rows N] [--cols N] [--map random|ordered|genomes|uniform|voronoi|stripes|invader]\n"
+			"              [--sites N] [--bitmap map.bmp] [--steps N]\n"
+			"              [--schedule sync|sequential|order] [--rule best|fermi|proportional]\n"
+			"              [--threads N] [--seed S] [--noise eps] [--mutation p] [--trace trace.json]\n"
+			"              [--numa local|first-touch|interleave] [--storage dir] [--memory N] [--predict T]\n"
+			"              [--frames frame%06lld.png] [--frame-format png|ppm] [--frame-block N] [--frame-tables 0|1]\n"
+			"              [--correlation out.csv] [--correlation-every K]\n"
+			"       NzgRun --tournament N [--memory N] [--rounds N] [--repeats N] [--threads N] [--seed S]\n";
+		return 1;
+	}
+
+#ifdef NZG_PROFILE
+	nzg::Profiler::get().setTracing(!s.trace.empty());
+#else
+	if (!s.trace.empty())
+		std::cerr << "Built without NZG_PROFILE, no trace is written\n";
+#endif
+
+	if (s.tournament >= 0)
+	{
+		runTournament(s);
+		return 0;
+	}
+
+	NzgNode node;
+	node.seed(s.seed);
+	node.threads = s.threads;
+	node.schedule = s.schedule;
+	node.rule = s.rule;
+	node.noise = s.noise;
+	node.mutation = s.mutation;
+	node.genomeMemory = s.memory;
+	node.placement = s.placement;
+	node.affinity = s.placement != nzg::Numa::Placement::local;
+	node.storage = s.storage;
+	try
+	{
+		if (!s.bitmap.empty() || s.map == NzgNode::MapType::voronoi)
+		{
+			nzg::MapGen gen(nzg::MapGen::Pattern::voronoi);
+			gen.seed = s.seed;
+			gen.sites = s.sites;
+			if (!s.bitmap.empty() && !gen.loadBitmap(s.bitmap))
+			{
+				std::cerr << "Can't load " << s.bitmap << "\n";
+				return 2;
+			}
+			node.setMap(gen, s.rows, s.cols);
+		}
+		else
+		{
+			node.setMap(s.map, s.rows, s.cols);
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << "\n";
+		return 2;
+	}
+	if (s.predict > 0)
+		printPrediction(node, s.predict);
+
+	node.resetTotalScores();
+	node.play();
+
+	if (s.frames.empty() && s.correlation.empty())
+	{
+		node.run(s.steps);
+	}
+	else
+	{
+		nzg::FrameWriter writer;
+		writer.format = s.frameFormat;
+		writer.block = s.frameBlock;
+		writer.pattern = s.frames;
+		writer.tables = s.frameTables;
+
+		nzg::Correlator cor;
+		cor.threads = s.threads;
+		std::ofstream os;
+		if (!s.correlation.empty())
+		{
+			os.open(s.correlation);
+			if (!os)
+			{
+				std::cerr << "Can't write " << s.correlation << "\n";
+				return 2;
+			}
+		}
+
+		for (const nzg::GenView& view : node.generations(1, s.steps))
+		{
+			if (!s.frames.empty())
+				writer.write(view);
+			if (os.is_open() && view.generation % s.correlationEvery == 0)
+			{
+				cor.analyse(view);
+				writeCorrelation(os, view.generation, cor);
+			}
+		}
+		writer.finish();
+		if (writer.getFailed() > 0)
+			std::cerr << "Can't write " << writer.getFailed() << " of the frames\n";
+	}
+
+	printTypes(node);
+
+#ifdef NZG_PROFILE
+	for (auto& line : nzg::Profiler::get().getSummary())
+		std::cout << line << "\n";
+
+	if (!s.trace.empty() && !nzg::Profiler::get().writeTrace(s.trace))
+	{
+		std::cerr << "Can't write " << s.trace << "\n";
+		return 2;
+	}
+#endif
+	return 0;
+}
@@ -53,6 +53,7 @@ nzg::Node* CNzgCtrl::getNode() const
 
 void CNzgCtrl::updateData()
 {
+	NZG_PROF_SCOPE("CNzgCtrl::updateData");
 	nzg::Node* pn = getNode();
 	if (pn == nullptr)
 		return;
@@ -78,15 +79,41 @@ void CNzgCtrl::updateData()
 	{
 		for (int y = 0; y < ny; y++)
 		{
-			double z = pnzg->sts(y, x)->totalScore;
+			double z = pnzg->sts.score(y, x);
 			int nv = y * nx + x;
 			m_oglColumns.m_pfVerts[nv * 3] = x + 0.5F;
 			m_oglColumns.m_pfVerts[nv * 3+1] = y + 0.5F;
 			m_oglColumns.m_pfVerts[nv * 3 + 2] = (float)z;
-			m_oglColumns.m_pdwColors[nv] = pnzg->sts(y, x)->getColor();
+			m_oglColumns.m_pdwColors[nv] = pnzg->strats.get(pnzg->sts.type(y, x)).getColor();
 		}
 	}
 
+	// Genome maps may hold thousands of types, show only the most frequent ones
+	std::vector<int64_t> counts(pnzg->strats.getCount(), 0);
+	const nzg::TypeId* pTypes = pnzg->sts.getTypes();
+	for (int64_t i = 0; i < pnzg->sts.getSize(); i++)
+		counts[pTypes[i]]++;
+	nzg::Pipeline::getLegend(counts, pnzg->strats.getStrats(), 24, m_legend);
+
+	Invalidate();
+}
+
+void CNzgCtrl::updateData(const nzg::Frame& frame)
+{
+	NZG_PROF_SCOPE("CNzgCtrl::updateData");
+	m_cubeScene = nzg::Cube3d(nzg::Point3d(0, 0, frame.minScore), nzg::Point3d(frame.cols - 1, frame.rows - 1, frame.maxScore));
+	m_cubeScene.onMinMax(nzg::Point3d(0, 0, 1));
+
+	m_oglColumns.reset();
+	m_oglColumns.m_nVerts = (int)frame.colors.size();
+	m_oglColumns.m_pfVerts = new float[frame.verts.size()];
+	m_oglColumns.m_pdwColors = new DWORD[frame.colors.size()];
+	m_oglColumns.m_size = nzg::Size2d(1, 1);
+	std::copy(frame.verts.begin(), frame.verts.end(), m_oglColumns.m_pfVerts);
+	std::copy(frame.colors.begin(), frame.colors.end(), m_oglColumns.m_pdwColors);
+
+	m_legend = frame.legend;
+
 	Invalidate();
 }
 
@@ -96,8 +123,7 @@ double CNzgCtrl::getData(const nzg::Node* node, double x, double y) const
 	nzg::NzgNode* pn = (nzg::NzgNode*)node;
 	int col = (int)(x / pn->sts.getCols());
 	int row = (int)(y / pn->sts.getRows());
-	const nzg::Strat* ps = pn->sts(row, col).get();
-	return ps->totalScore;
+	return pn->sts.score(row, col);
 }
 
 void CNzgCtrl::onViewChanged()
@@ -171,23 +197,7 @@ void CNzgCtrl::drawLegend()
 
 	glLoadIdentity();
 
-	std::map<DWORD, std::string> types;
-
-	nzg::NzgNode* node = (nzg::NzgNode *)getNode();
-	for (int i = 0; i < node->sts.getRows(); i++)
-	{
-		for (int j = 0; j < node->sts.getCols(); j++)
-		{
-			nzg::Strat* p = node->sts(i, j).get();
-
-			DWORD clr = p->getColor();
-			if (types.find(clr) == types.end())
-			{
-				types[clr] = p->c_types[(int)p->type];
-			}
-		}
-	}
-
+	const std::vector<std::pair<DWORD, std::string>>& types = m_legend;
 
 	int nSec = types.size();
 	double step = size.cy / (nSec + 2);
@@ -264,6 +274,9 @@ void CNzgView::DoDataExchange(CDataExchange* pDX)
 	DDX_Control(pDX, IDC_CUSTOM_PLOT, m_wndPlot);
 	DDX_Text(pDX, IDC_EDIT_ROWS, m_rows);
 	DDX_Text(pDX, IDC_EDIT_COLS, m_cols);
+	DDX_Control(pDX, IDC_COMBO_SCHEDULE, m_cmbSchedule);
+	DDX_Control(pDX, IDC_COMBO_RULE, m_cmbRule);
+	DDX_Control(pDX, IDC_COMBO_MAP, m_cmbMap);
 	//DDX_Control(pDX, IDC_COMBO_SIGNAL, m_cmbSignal);
 	//DDX_Control(pDX, IDC_COMBO_VIEW_AT, m_cmbViewAt);
 	//DDX_Control(pDX, IDC_COMBO_LABELS, m_cmbLabels);
@@ -276,6 +289,8 @@ BEGIN_MESSAGE_MAP(CNzgView, CFormView)
 	ON_BN_CLICKED(IDC_BUTTON_RESET, &CNzgView::OnBnClickedButtonReset)
 	ON_EN_CHANGE(IDC_EDIT_ROWS, onChangeSize)
 	ON_EN_CHANGE(IDC_EDIT_COLS, onChangeSize)
+	ON_CBN_SELCHANGE(IDC_COMBO_SCHEDULE, onSelChangeSchedule)
+	ON_CBN_SELCHANGE(IDC_COMBO_RULE, onSelChangeRule)
 	ON_WM_TIMER()
 END_MESSAGE_MAP()
 
@@ -357,6 +372,27 @@ void CNzgView::OnInitialUpdate()
 
 	m_wndPlot.onInitialUpdate();
 
+	m_cmbSchedule.ResetContent();
+	for (int i = 0; i < (int)nzg::NzgNode::Schedule::maxSchedule; i++)
+	{
+		m_cmbSchedule.AddString(CString(nzg::NzgNode::c_schedules[i]));
+	}
+	m_cmbSchedule.SetCurSel((int)getNode()->schedule);
+
+	m_cmbRule.ResetContent();
+	for (int i = 0; i < (int)nzg::NzgNode::Rule::maxRule; i++)
+	{
+		m_cmbRule.AddString(CString(nzg::NzgNode::c_rules[i]));
+	}
+	m_cmbRule.SetCurSel((int)getNode()->rule);
+
+	m_cmbMap.ResetContent();
+	for (int i = 0; i < (int)nzg::NzgNode::MapType::maxMapType; i++)
+	{
+		m_cmbMap.AddString(CString(nzg::NzgNode::c_mapTypes[i]));
+	}
+	m_cmbMap.SetCurSel(0);
+
 	m_wndPlot.updateData();
 }
 
@@ -365,9 +401,8 @@ void CNzgView::OnBnClickedButtonPlay()
 {
 	nzg::NzgNode* node = getNode();
 
-	node->updateStrat();
-	node->resetTotalScores();
-	node->play();
+	CWaitCursor wc;
+	node->step();
 	m_wndPlot.updateData();
 	m_wndPlot.Invalidate();
 }
@@ -376,15 +411,19 @@ void CNzgView::OnBnClickedButtonPlay2()
 {
 	nzg::NzgNode* node = getNode();
 
-	for (int i = 0; i < 100; i++)
+	// The engine runs on, the plot shows the newest frame whenever it is done with one
+	CWaitCursor wc;
+	nzg::Pipeline pipeline(*node);
+	pipeline.start(100);
+	while (nzg::Frame* pFrame = pipeline.take())
 	{
-		node->updateStrat();
-		node->resetTotalScores();
-		node->play();
-		m_wndPlot.updateData();
-		m_wndPlot.Invalidate();
+		m_wndPlot.updateData(*pFrame);
 		m_wndPlot.UpdateWindow();
+		pipeline.release(pFrame);
 	}
+	pipeline.stop();
+	m_wndPlot.updateData();
+	m_wndPlot.Invalidate();
 }
 
 void CNzgView::OnBnClickedButtonReset()
@@ -393,7 +432,8 @@ void CNzgView::OnBnClickedButtonReset()
 
 	UpdateData(TRUE);
 
-	node->reset(m_rows, m_cols, nzg::NzgNode::MapType::random);
+	int nMap = m_cmbMap.GetCurSel();
+	node->reset(m_rows, m_cols, nMap < 0 ? nzg::NzgNode::MapType::random : (nzg::NzgNode::MapType)nMap);
 	m_wndPlot.updateData();
 	m_wndPlot.Invalidate();
 }
@@ -403,6 +443,24 @@ void CNzgView::onChangeSize()
 	SetTimer(1, 1000, NULL);
 }
 
+void CNzgView::onSelChangeSchedule()
+{
+	int nSel = m_cmbSchedule.GetCurSel();
+	if (nSel < 0)
+		return;
+
+	getNode()->schedule = (nzg::NzgNode::Schedule)nSel;
+}
+
+void CNzgView::onSelChangeRule()
+{
+	int nSel = m_cmbRule.GetCurSel();
+	if (nSel < 0)
+		return;
+
+	getNode()->rule = (nzg::NzgNode::Rule)nSel;
+}
+
 void CNzgView::OnTimer(UINT nTimerID)
 {
 	if (nTimerID == 1)
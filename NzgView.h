@@ -3,6 +3,7 @@
 #include "Plot3d.h"
 #include "NzgNode.h"
 #include "NzgDoc.h"
+#include "Pipeline.h"
 
 class CNzgView;
 class CNzgDoc;
@@ -17,6 +18,7 @@ public:
 	// Attributes:
 public:
 	CNzgView* m_pView;
+	std::vector<std::pair<DWORD, std::string>> m_legend;
 
 	// Overrides:
 public:
@@ -29,6 +31,9 @@ public:
 	virtual void updateScale();
 	void drawLegend();
 
+	// Operations:
+public:
+	void updateData(const nzg::Frame& frame); // From a frame of a running Pipeline, without touching the node
 };
 
 
@@ -63,6 +68,9 @@ public:
 	}
 
 	CNzgCtrl m_wndPlot;
+	CComboBox m_cmbSchedule;
+	CComboBox m_cmbRule;
+	CComboBox m_cmbMap;
 	int m_rows;
 	int m_cols;
 
@@ -78,6 +86,8 @@ public:
 	afx_msg void OnBnClickedButtonPlay2();
 	afx_msg void OnBnClickedButtonReset();
 	afx_msg void onChangeSize();
+	afx_msg void onSelChangeSchedule();
+	afx_msg void onSelChangeRule();
 	afx_msg void OnTimer(UINT nID);
 };
 
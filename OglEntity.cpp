@@ -38,6 +38,7 @@
 #include "Angles.h"
 #include "OglEntity.h"
 #include "Plot3d.h"
+#include "Profiler.h"
 //#include "GnssModel.h"
 
 
@@ -1311,6 +1312,7 @@ namespace nzg
 
 	void OglColumns::draw()
 	{
+		NZG_PROF_SCOPE("OglColumns::draw");
 		for (int i = 0; i < m_nVerts; i++)
 		{
 			drawColumn(m_pfVerts[3 * i], m_pfVerts[3 * i + 1], m_pfVerts[3 * i + 2], m_pdwColors[i]);
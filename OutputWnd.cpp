@@ -5,6 +5,7 @@
 #include "OutputWnd.h"
 #include "Resource.h"
 #include "MainFrm.h"
+#include "Profiler.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -26,6 +27,7 @@ COutputWnd::~COutputWnd()
 BEGIN_MESSAGE_MAP(COutputWnd, CDockablePane)
 	ON_WM_CREATE()
 	ON_WM_SIZE()
+	ON_WM_TIMER()
 END_MESSAGE_MAP()
 
 int COutputWnd::OnCreate(LPCREATESTRUCT lpCreateStruct)
@@ -48,7 +50,8 @@ int COutputWnd::OnCreate(LPCREATESTRUCT lpCreateStruct)
 
 	if (!m_wndOutputBuild.Create(dwStyle, rectDummy, &m_wndTabs, 2) ||
 		!m_wndOutputDebug.Create(dwStyle, rectDummy, &m_wndTabs, 3) ||
-		!m_wndOutputFind.Create(dwStyle, rectDummy, &m_wndTabs, 4))
+		!m_wndOutputFind.Create(dwStyle, rectDummy, &m_wndTabs, 4) ||
+		!m_wndOutputProfile.Create(dwStyle, rectDummy, &m_wndTabs, 5))
 	{
 		TRACE0("Failed to create output windows\n");
 		return -1;      // fail to create
@@ -69,11 +72,19 @@ int COutputWnd::OnCreate(LPCREATESTRUCT lpCreateStruct)
 	bNameValid = strTabName.LoadString(IDS_FIND_TAB);
 	ASSERT(bNameValid);
 	m_wndTabs.AddTab(&m_wndOutputFind, strTabName, (UINT)2);
+	bNameValid = strTabName.LoadString(IDS_PROFILE_TAB);
+	ASSERT(bNameValid);
+	m_wndTabs.AddTab(&m_wndOutputProfile, strTabName, (UINT)3);
 
 	// Fill output tabs with some dummy text (nothing magic here)
 	FillBuildWindow();
 	FillDebugWindow();
 	FillFindWindow();
+	FillProfileWindow();
+
+#ifdef NZG_PROFILE
+	SetTimer(1, 1000, nullptr);
+#endif
 
 	return 0;
 }
@@ -126,11 +137,46 @@ void COutputWnd::FillFindWindow()
 	m_wndOutputFind.AddString(_T("but you can change the way it is displayed as you wish..."));
 }
 
+// Live summary of the simulation profiler, refreshed every second
+void COutputWnd::FillProfileWindow()
+{
+#ifdef NZG_PROFILE
+	std::vector<std::string> lines = nzg::Profiler::get().getSummary();
+	m_wndOutputProfile.SetRedraw(FALSE);
+	for (int i = 0; i < (int)lines.size(); i++)
+	{
+		CString str(lines[i].c_str());
+		if (i < m_wndOutputProfile.GetCount())
+		{
+			CString strOld;
+			m_wndOutputProfile.GetText(i, strOld);
+			if (strOld == str)
+				continue;
+			m_wndOutputProfile.DeleteString(i);
+		}
+		m_wndOutputProfile.InsertString(i, str);
+	}
+	m_wndOutputProfile.SetRedraw(TRUE);
+	m_wndOutputProfile.Invalidate();
+#else
+	m_wndOutputProfile.AddString(_T("Profiling is off, build with NZG_PROFILE to enable it."));
+#endif
+}
+
+void COutputWnd::OnTimer(UINT_PTR nIDEvent)
+{
+	if (nIDEvent == 1 && m_wndOutputProfile.IsWindowVisible())
+		FillProfileWindow();
+
+	CDockablePane::OnTimer(nIDEvent);
+}
+
 void COutputWnd::UpdateFonts()
 {
 	m_wndOutputBuild.SetFont(&afxGlobalData.fontRegular);
 	m_wndOutputDebug.SetFont(&afxGlobalData.fontRegular);
 	m_wndOutputFind.SetFont(&afxGlobalData.fontRegular);
+	m_wndOutputProfile.SetFont(&afxGlobalData.fontRegular);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -38,11 +38,13 @@ protected:
 	COutputList m_wndOutputBuild;
 	COutputList m_wndOutputDebug;
 	COutputList m_wndOutputFind;
+	COutputList m_wndOutputProfile;
 
 protected:
 	void FillBuildWindow();
 	void FillDebugWindow();
 	void FillFindWindow();
+	void FillProfileWindow();
 
 	void AdjustHorzScroll(CListBox& wndListBox);
 
@@ -53,6 +55,7 @@ public:
 protected:
 	afx_msg int OnCreate(LPCREATESTRUCT lpCreateStruct);
 	afx_msg void OnSize(UINT nType, int cx, int cy);
+	afx_msg void OnTimer(UINT_PTR nIDEvent);
 
 	DECLARE_MESSAGE_MAP()
 };
@@ -0,0 +1,314 @@
+#include "pch.h"
+
+#include "Pipeline.h"
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Pipeline implementation
+	Pipeline::Pipeline(NzgNode& node, int nFrames) : every(1), maxLegend(24), maxCells(1 << 22), m_node(node), m_bStop(false),
+		m_nDropped(0), m_bDone(true), m_bEnd(false)
+	{
+		for (int i = 0; i < std::max(nFrames, 2); i++)
+			m_frames.emplace_back(new Frame());
+	}
+
+	Pipeline::~Pipeline()
+	{
+		stop();
+	}
+
+	void Pipeline::start(int64_t nGenerations)
+	{
+		stop();
+
+		// Every queue can hold all the frames and the end marker, so no push fails
+		size_t capacity = m_frames.size() + 1;
+		m_free.reset(capacity);
+		m_recycled.reset(capacity);
+		m_toAnalysis.reset(capacity);
+		m_toRender.reset(capacity);
+		m_ready.reset(capacity);
+		for (auto& pFrame : m_frames)
+			m_free.push(pFrame.get());
+
+		m_bStop = false;
+		m_nDropped = 0;
+		m_bDone = false;
+		m_bEnd = false;
+		m_renderThread = std::thread(&Pipeline::render, this);
+		m_analysisThread = std::thread(&Pipeline::analyse, this);
+		m_simThread = std::thread(&Pipeline::simulate, this, nGenerations);
+	}
+
+	void Pipeline::stop()
+	{
+		if (!isRunning())
+			return;
+
+		m_bStop = true;
+		m_simThread.join();
+		m_analysisThread.join();
+		m_renderThread.join();
+		m_bDone = true;
+	}
+
+	Frame* Pipeline::take(bool bWait)
+	{
+		if (m_bDone)
+			return nullptr;
+		if (m_bEnd)
+		{
+			m_bDone = true;
+			return nullptr;
+		}
+
+		Frame* pFrame = nullptr;
+		if (bWait)
+			m_ready.waitPop(pFrame);
+		else if (!m_ready.pop(pFrame))
+			return nullptr;
+
+		Frame* pNext;
+		while (pFrame != nullptr && m_ready.pop(pNext))
+		{
+			// The last frame goes out before the end
+			if (pNext == nullptr)
+			{
+				m_bEnd = true;
+				break;
+			}
+			release(pFrame);
+			pFrame = pNext;
+		}
+		if (pFrame == nullptr)
+			m_bDone = true;
+		return pFrame;
+	}
+
+	void Pipeline::release(Frame* pFrame)
+	{
+		if (pFrame != nullptr)
+			m_free.push(pFrame);
+	}
+
+	void Pipeline::simulate(int64_t nGenerations)
+	{
+		for (int64_t g = 0; !m_bStop && (nGenerations < 0 || g < nGenerations); )
+		{
+			int nSteps = std::max(every, 1);
+			if (nGenerations >= 0)
+				nSteps = (int)std::min<int64_t>(nSteps, nGenerations - g);
+			m_node.run(nSteps);
+			m_node.updateScores();
+			g += nSteps;
+
+			Frame* pFrame;
+			if (!m_free.pop(pFrame) && !m_recycled.pop(pFrame))
+			{
+				m_nDropped++;
+				continue;
+			}
+			snapshot(*pFrame);
+			m_toAnalysis.push(pFrame);
+		}
+		m_toAnalysis.push(nullptr);
+	}
+
+	void Pipeline::analyse()
+	{
+		for (;;)
+		{
+			Frame* pFrame;
+			m_toAnalysis.waitPop(pFrame);
+
+			// Skip to the newest frame, the simulation has moved on anyway
+			Frame* pNext;
+			while (pFrame != nullptr && m_toAnalysis.pop(pNext))
+			{
+				if (pNext == nullptr)
+				{
+					analyseFrame(*pFrame);
+					m_toRender.push(pFrame);
+					pFrame = nullptr;
+					break;
+				}
+				m_nDropped++;
+				m_recycled.push(pFrame);
+				pFrame = pNext;
+			}
+
+			if (pFrame == nullptr)
+			{
+				m_toRender.push(nullptr);
+				return;
+			}
+			analyseFrame(*pFrame);
+			m_toRender.push(pFrame);
+		}
+	}
+
+	void Pipeline::render()
+	{
+		for (;;)
+		{
+			Frame* pFrame;
+			m_toRender.waitPop(pFrame);
+			if (pFrame != nullptr)
+				renderFrame(*pFrame);
+			m_ready.push(pFrame);
+			if (pFrame == nullptr)
+				return;
+		}
+	}
+
+	// The only stage that reads the node, on the simulation thread between two runs.
+	// Only the rows of the sample are read, the pages of a mapped map stay on disk
+	void Pipeline::snapshot(Frame& f) const
+	{
+		NZG_PROF_SCOPE("Pipeline::snapshot");
+		const StratMatrix& sts = m_node.sts;
+		int rows = sts.getRows();
+		int cols = sts.getCols();
+		int64_t nMax = std::max<int64_t>(maxCells, 1);
+		int stride = std::max(1, (int)std::sqrt((double)sts.getSize() / nMax));
+		while ((int64_t)((rows + stride - 1) / stride) * ((cols + stride - 1) / stride) > nMax)
+			stride++;
+
+		f.generation = m_node.getGeneration();
+		f.rows = (rows + stride - 1) / stride;
+		f.cols = (cols + stride - 1) / stride;
+		f.stride = stride;
+		f.types.resize((size_t)f.rows * f.cols);
+		f.scores.resize((size_t)f.rows * f.cols);
+		for (int i = 0; i < f.rows; i++)
+		{
+			const TypeId* pTypes = sts.getTypeRow(i * stride);
+			const int* pScores = sts.getScoreRow(i * stride);
+			size_t nf = (size_t)i * f.cols;
+			for (int j = 0; j < f.cols; j++)
+			{
+				f.types[nf + j] = pTypes[(size_t)j * stride];
+				f.scores[nf + j] = pScores[(size_t)j * stride];
+			}
+		}
+		f.strats = m_node.strats.getStrats();
+	}
+
+	void Pipeline::analyseFrame(Frame& f)
+	{
+		NZG_PROF_SCOPE("Pipeline::analyseFrame");
+		int64_t n = (int64_t)f.types.size();
+		f.counts.assign(f.strats.size(), 0);
+		int64_t sum = 0;
+		f.minScore = n > 0 ? f.scores[0] : 0;
+		f.maxScore = f.minScore;
+		for (int64_t i = 0; i < n; i++)
+		{
+			f.counts[f.types[i]]++;
+			sum += f.scores[i];
+			f.minScore = std::min(f.minScore, f.scores[i]);
+			f.maxScore = std::max(f.maxScore, f.scores[i]);
+		}
+		f.meanScore = n > 0 ? (double)sum / n : 0;
+		f.clusters = countClusters(f);
+		getLegend(f.counts, f.strats, maxLegend, f.legend);
+	}
+
+	int64_t Pipeline::countClusters(Frame& f)
+	{
+		f.largestCluster = 0;
+		size_t n = f.types.size();
+		if (n == 0 || n > UINT32_MAX)
+			return n == 0 ? 0 : -1;
+
+		m_parent.resize(n);
+		for (size_t i = 0; i < n; i++)
+			m_parent[i] = (uint32_t)i;
+		auto find = [&](uint32_t i) {
+			while (m_parent[i] != i)
+			{
+				m_parent[i] = m_parent[m_parent[i]];
+				i = m_parent[i];
+			}
+			return i;
+		};
+		auto unite = [&](uint32_t a, uint32_t b) {
+			a = find(a);
+			b = find(b);
+			if (a < b)
+				m_parent[b] = a;
+			else if (b < a)
+				m_parent[a] = b;
+		};
+
+		for (int r = 0; r < f.rows; r++)
+		{
+			size_t row = (size_t)r * f.cols;
+			size_t down = (size_t)(r + 1 < f.rows ? r + 1 : 0) * f.cols;
+			for (int c = 0; c < f.cols; c++)
+			{
+				size_t i = row + c;
+				size_t right = row + (c + 1 < f.cols ? c + 1 : 0);
+				if (f.types[right] == f.types[i])
+					unite((uint32_t)i, (uint32_t)right);
+				if (f.types[down + c] == f.types[i])
+					unite((uint32_t)i, (uint32_t)(down + c));
+			}
+		}
+
+		int64_t nClusters = 0;
+		m_sizes.assign(n, 0);
+		for (size_t i = 0; i < n; i++)
+		{
+			uint32_t root = find((uint32_t)i);
+			if (root == i)
+				nClusters++;
+			f.largestCluster = std::max(f.largestCluster, (int64_t)++m_sizes[root]);
+		}
+		return nClusters;
+	}
+
+	void Pipeline::renderFrame(Frame& f) const
+	{
+		NZG_PROF_SCOPE("Pipeline::renderFrame");
+		std::vector<DWORD> lut(f.strats.size());
+		for (size_t i = 0; i < lut.size(); i++)
+			lut[i] = f.strats[i].getColor();
+
+		size_t n = f.types.size();
+		f.verts.resize(n * 3);
+		f.colors.resize(n);
+		for (int y = 0; y < f.rows; y++)
+		{
+			for (int x = 0; x < f.cols; x++)
+			{
+				size_t nv = (size_t)y * f.cols + x;
+				f.verts[nv * 3] = x + 0.5F;
+				f.verts[nv * 3 + 1] = y + 0.5F;
+				f.verts[nv * 3 + 2] = (float)f.scores[nv];
+				f.colors[nv] = lut[f.types[nv]];
+			}
+		}
+	}
+
+	void Pipeline::getLegend(const std::vector<int64_t>& counts, const std::vector<Strat>& strats, size_t maxLegend,
+		std::vector<std::pair<DWORD, std::string>>& legend)
+	{
+		std::vector<std::pair<int64_t, TypeId>> order(counts.size());
+		for (size_t i = 0; i < order.size(); i++)
+			order[i] = std::make_pair(-counts[i], (TypeId)i);
+		size_t nLegend = std::min(maxLegend, order.size());
+		std::partial_sort(order.begin(), order.begin() + nLegend, order.end());
+
+		std::map<DWORD, std::string> types;
+		for (size_t i = 0; i < nLegend && order[i].first < 0; i++)
+		{
+			const Strat& st = strats[order[i].second];
+			types.emplace(st.getColor(), st.getName());
+		}
+		legend.assign(types.begin(), types.end());
+	}
+	// End of Pipeline implementation
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "NzgNode.h"
+#include "SpscQueue.h"
+
+namespace nzg
+{
+	// Frame - one generation on its way through the Pipeline: the copy the simulation
+	// takes, what the analysis finds in it and the buffers the renderer draws
+	struct Frame
+	{
+		// Simulation
+		int64_t generation;
+		int rows;
+		int cols;
+		int stride;		// Rows and columns of the map per cell of the frame, 1 for a full copy
+		std::vector<TypeId> types;
+		std::vector<int> scores;
+		std::vector<Strat> strats;	// Strategy of every type id
+
+		// Analysis
+		std::vector<int64_t> counts; // Cells per type id of the frame
+		int minScore;
+		int maxScore;
+		double meanScore;
+		int64_t clusters;		// Connected areas of one type, 4-neighbourhood on the torus; -1 if not counted
+		int64_t largestCluster;
+		std::vector<std::pair<DWORD, std::string>> legend; // Colours and names of the most frequent types
+
+		// Render
+		std::vector<float> verts;	// x, y, z of the column of every cell
+		std::vector<DWORD> colors;
+	};
+
+	////////////////////////////////////////////////////////////////////////////////
+	// Pipeline - runs a node on a thread of its own and passes copies of its generations
+	// to an analysis thread, a render thread and on to one consumer. Frames come from a
+	// fixed pool and go back to it when the consumer releases them. When the pool runs
+	// dry the simulation drops the generation and goes on, and the analysis skips to the
+	// newest frame waiting, so a slow stage loses frames but never holds the engine back.
+	// The frames of a map of more than maxCells cells, such as a file mapped one, are
+	// samples of it and the analysis counts the cells of the sample.
+	class Pipeline
+	{
+	// Construction:
+	public:
+		explicit Pipeline(NzgNode& node, int nFrames = 4);
+		~Pipeline();
+
+	// Attributes:
+	public:
+		int every;		// Generations between two frames
+		size_t maxLegend;
+		int64_t maxCells; // Cells of a frame at most, bigger maps are sampled every stride rows and columns
+
+		bool isRunning() const { return m_simThread.joinable(); }
+		int64_t getDropped() const { return m_nDropped.load(std::memory_order_relaxed); }
+
+	// Operations:
+	public:
+		// Runs nGenerations generations, or until stop() for -1. The node must not be
+		// touched by anybody else until stop().
+		void start(int64_t nGenerations = -1);
+		void stop();
+
+		// Consumer: newest frame ready, releasing the older ones. With bWait it waits for
+		// one and returns nullptr only once the run is over, else nullptr if none is ready.
+		Frame* take(bool bWait = true);
+		void release(Frame* pFrame);
+
+		// Legend entries of the most frequent types, by colour
+		static void getLegend(const std::vector<int64_t>& counts, const std::vector<Strat>& strats, size_t maxLegend,
+			std::vector<std::pair<DWORD, std::string>>& legend);
+
+	// Implementation:
+	protected:
+		NzgNode& m_node;
+		std::vector<std::unique_ptr<Frame>> m_frames;
+
+		// Frames go free -> analysis -> render -> ready -> free; the analysis hands the
+		// frames it skips back through recycled, each queue has one thread on either side
+		SpscQueue<Frame*> m_free;
+		SpscQueue<Frame*> m_recycled;
+		SpscQueue<Frame*> m_toAnalysis;
+		SpscQueue<Frame*> m_toRender;
+		SpscQueue<Frame*> m_ready;
+
+		std::thread m_simThread;
+		std::thread m_analysisThread;
+		std::thread m_renderThread;
+		std::atomic<bool> m_bStop;
+		std::atomic<int64_t> m_nDropped;
+		bool m_bDone; // The consumer has seen the end of the run
+		bool m_bEnd; // The end came right behind the last frame taken
+		std::vector<uint32_t> m_parent; // Union-find forest of the cluster count
+		std::vector<uint32_t> m_sizes;
+
+		void simulate(int64_t nGenerations);
+		void analyse();
+		void render();
+		void snapshot(Frame& f) const;
+		void analyseFrame(Frame& f);
+		void renderFrame(Frame& f) const;
+		int64_t countClusters(Frame& f);
+	};
+	// End of Pipeline
+	////////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,82 @@
+#include "pch.h"
+
+#include "PlaneFile.h"
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	// PlaneFile implementation
+	PlaneFile::PlaneFile() : m_hFile(INVALID_HANDLE_VALUE), m_hMap(nullptr), m_pData(nullptr), m_size(0)
+	{
+	}
+
+	PlaneFile::~PlaneFile()
+	{
+		close();
+	}
+
+	bool PlaneFile::open(const std::string& path, size_t bytes)
+	{
+		close();
+
+		m_hFile = CreateFileW(std::filesystem::path(path).wstring().c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+			CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+		if (m_hFile == INVALID_HANDLE_VALUE)
+			return false;
+
+		// The mapping grows the file to its size, a mapping of nothing is an error
+		ULARGE_INTEGER size;
+		size.QuadPart = std::max(bytes, (size_t)1);
+		m_hMap = CreateFileMappingW(m_hFile, nullptr, PAGE_READWRITE, size.HighPart, size.LowPart, nullptr);
+		if (m_hMap != nullptr)
+			m_pData = MapViewOfFile(m_hMap, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+		if (m_pData == nullptr)
+		{
+			close();
+			return false;
+		}
+		m_size = bytes;
+		return true;
+	}
+
+	void PlaneFile::close()
+	{
+		if (m_pData != nullptr)
+			UnmapViewOfFile(m_pData);
+		if (m_hMap != nullptr)
+			CloseHandle(m_hMap);
+		if (m_hFile != INVALID_HANDLE_VALUE)
+			CloseHandle(m_hFile);
+		m_hFile = INVALID_HANDLE_VALUE;
+		m_hMap = nullptr;
+		m_pData = nullptr;
+		m_size = 0;
+	}
+
+	void PlaneFile::prefetch(size_t offset, size_t bytes) const
+	{
+		if (m_pData == nullptr || offset >= m_size)
+			return;
+
+		WIN32_MEMORY_RANGE_ENTRY range;
+		range.VirtualAddress = (char*)m_pData + offset;
+		range.NumberOfBytes = std::min(bytes, m_size - offset);
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	}
+
+	// VirtualUnlock of pages that are not locked takes them out of the working set.
+	// Pages shared with the rows around the range stay.
+	void PlaneFile::release(size_t offset, size_t bytes) const
+	{
+		if (m_pData == nullptr || offset >= m_size)
+			return;
+
+		const size_t page = 4096;
+		size_t begin = (offset + page - 1) / page * page;
+		size_t end = std::min(offset + bytes, m_size) / page * page;
+		if (begin < end)
+			VirtualUnlock((char*)m_pData + begin, end - begin);
+	}
+	// End of PlaneFile implementation
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////
+	// PlaneFile - scratch file mapped whole into memory, the backing store of a plane
+	// too big for RAM. The system pages it in and out by itself; a kernel that walks
+	// the plane in order tells it which rows come next and which are done with.
+	// The file is deleted when it is closed.
+	class PlaneFile
+	{
+	// Construction:
+	public:
+		PlaneFile();
+		~PlaneFile();
+		PlaneFile(const PlaneFile&) = delete;
+		PlaneFile& operator=(const PlaneFile&) = delete;
+
+		// Creates the file of bytes zeros, replacing any file of the name, and maps it
+		bool open(const std::string& path, size_t bytes);
+		void close();
+
+	// Attributes:
+	public:
+		void* getData() const { return m_pData; }
+		size_t getSize() const { return m_size; }
+
+	// Operations:
+	public:
+		// Start reading the range in ahead of its use
+		void prefetch(size_t offset, size_t bytes) const;
+		// Drop the whole pages of the range from the working set, dirty ones go to the file
+		void release(size_t offset, size_t bytes) const;
+
+	// Implementation:
+	protected:
+		HANDLE m_hFile;
+		HANDLE m_hMap;
+		void* m_pData;
+		size_t m_size;
+	};
+	// End of PlaneFile
+	////////////////////////////////////////////////////////////////////////////////
+}
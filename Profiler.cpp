@@ -0,0 +1,151 @@
+#include "pch.h"
+
+#include "Profiler.h"
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Profiler implementation
+	const char* Profiler::c_counters[maxCounter] = {
+		"games",
+		"simulated games",
+		"cells changed"
+	};
+
+	Profiler& Profiler::get()
+	{
+		static Profiler profiler;
+		return profiler;
+	}
+
+	Profiler::Profiler() : m_nPhases(0), m_bTrace(false), m_start(std::chrono::steady_clock::now())
+	{
+		for (auto& ph : m_phases)
+		{
+			ph.name = nullptr;
+			ph.calls = 0;
+			ph.ns = 0;
+		}
+		for (auto& c : m_counters)
+			c = 0;
+	}
+
+	// Called once per NZG_PROF_SCOPE site, from the initialisation of its static id
+	int Profiler::addPhase(const char* name)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		int n = m_nPhases.load();
+		for (int i = 0; i < n; i++)
+		{
+			if (strcmp(m_phases[i].name, name) == 0)
+				return i;
+		}
+		if (n == maxPhases)
+			return maxPhases - 1;
+
+		m_phases[n].name = name;
+		m_nPhases = n + 1;
+		return n;
+	}
+
+	void Profiler::add(int nPhase, int64_t t0, int64_t t1)
+	{
+		Phase& ph = m_phases[nPhase];
+		ph.calls.fetch_add(1, std::memory_order_relaxed);
+		ph.ns.fetch_add(t1 - t0, std::memory_order_relaxed);
+
+		if (m_bTrace.load(std::memory_order_relaxed))
+		{
+			Event e = { nPhase, getThreadIndex(), t0, t1 };
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_events.push_back(e);
+		}
+	}
+
+	int64_t Profiler::now() const
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+	}
+
+	void Profiler::setTracing(bool bTrace)
+	{
+		m_bTrace = bTrace;
+	}
+
+	void Profiler::reset()
+	{
+		for (auto& ph : m_phases)
+		{
+			ph.calls = 0;
+			ph.ns = 0;
+		}
+		for (auto& c : m_counters)
+			c = 0;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_events.clear();
+	}
+
+	std::vector<std::string> Profiler::getSummary() const
+	{
+		std::vector<std::string> lines;
+		char sz[256];
+		int n = m_nPhases.load();
+		for (int i = 0; i < n; i++)
+		{
+			const Phase& ph = m_phases[i];
+			int64_t calls = ph.calls.load(std::memory_order_relaxed);
+			double ms = ph.ns.load(std::memory_order_relaxed) * 1e-6;
+			snprintf(sz, sizeof(sz), "%s: %lld calls, %.1f ms, %.3f ms/call", ph.name, (long long)calls, ms,
+				calls > 0 ? ms / calls : 0.0);
+			lines.push_back(sz);
+		}
+
+		for (int i = 0; i < maxCounter; i++)
+		{
+			snprintf(sz, sizeof(sz), "%s: %lld", c_counters[i], (long long)getCount((Counter)i));
+			lines.push_back(sz);
+		}
+
+		int64_t games = getCount(cntGames);
+		if (games > 0)
+		{
+			snprintf(sz, sizeof(sz), "table hits: %.1f%%", 100.0 * (games - getCount(cntSimulated)) / games);
+			lines.push_back(sz);
+		}
+		return lines;
+	}
+
+	// Chrome trace event format: complete events ("ph": "X") with times in microseconds
+	bool Profiler::writeTrace(const std::string& path) const
+	{
+		std::ofstream ofs(path);
+		if (!ofs)
+			return false;
+
+		// Microseconds with the nanoseconds kept; the default 6 significant digits would
+		// switch to exponents after a second and round away more the longer the run
+		std::lock_guard<std::mutex> lock(m_mutex);
+		ofs << std::fixed << std::setprecision(3);
+		ofs << "{\"traceEvents\":[\n";
+		for (size_t i = 0; i < m_events.size(); i++)
+		{
+			const Event& e = m_events[i];
+			ofs << "{\"name\":\"" << m_phases[e.nPhase].name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.nThread
+				<< ",\"ts\":" << e.t0 / 1000.0 << ",\"dur\":" << (e.t1 - e.t0) / 1000.0 << "}"
+				<< (i + 1 < m_events.size() ? ",\n" : "\n");
+		}
+		ofs << "],\"displayTimeUnit\":\"ms\"}\n";
+		return (bool)ofs;
+	}
+
+	// Small stable thread numbers for the trace
+	int Profiler::getThreadIndex()
+	{
+		static std::atomic<int> nThreads(0);
+		thread_local int nThread = nThreads++;
+		return nThread;
+	}
+	// End of Profiler implementation
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+}
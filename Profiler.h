@@ -0,0 +1,111 @@
+#pragma once
+
+#include <mutex>
+#include <chrono>
+
+// Scoped phase timers and event counters of the simulation hot paths.
+// Everything compiles to nothing unless NZG_PROFILE is defined:
+//
+//   NZG_PROF_SCOPE("NzgNode::play");             // times the enclosing block
+//   NZG_PROF_COUNT(nzg::Profiler::cntGames, n);  // adds n to a counter
+//
+#ifdef NZG_PROFILE
+#define NZG_PROF_CONCAT2(a, b) a##b
+#define NZG_PROF_CONCAT(a, b) NZG_PROF_CONCAT2(a, b)
+#define NZG_PROF_SCOPE(name) \
+	static const int NZG_PROF_CONCAT(nzgProfId, __LINE__) = nzg::Profiler::get().addPhase(name); \
+	nzg::ProfScope NZG_PROF_CONCAT(nzgProfScope, __LINE__)(NZG_PROF_CONCAT(nzgProfId, __LINE__))
+#define NZG_PROF_COUNT(counter, n) nzg::Profiler::get().count(counter, n)
+#else
+#define NZG_PROF_SCOPE(name) ((void)0)
+#define NZG_PROF_COUNT(counter, n) ((void)sizeof(n))
+#endif
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////
+	// Profiler - process wide totals of the phases and counters, and optionally
+	// a log of every timed scope for a Chrome trace (chrome://tracing, Perfetto)
+	class Profiler
+	{
+	// Construction:
+	public:
+		static Profiler& get();
+
+		enum Counter
+		{
+			cntGames = 0,		// Matches played
+			cntSimulated = 1,	// Matches simulated move by move instead of read from the payoff table
+			cntCellsChanged = 2, // Cells that took a new type
+			maxCounter
+		};
+		static const char* c_counters[maxCounter];
+
+	// Attributes:
+	public:
+		bool isTracing() const { return m_bTrace; }
+		int64_t getCount(Counter c) const { return m_counters[c].load(std::memory_order_relaxed); }
+
+	// Operations:
+	public:
+		int addPhase(const char* name);
+		void add(int nPhase, int64_t t0, int64_t t1);
+		void count(Counter c, int64_t n) {
+			m_counters[c].fetch_add(n, std::memory_order_relaxed);
+		}
+		int64_t now() const; // Nanoseconds since the profiler started
+
+		void setTracing(bool bTrace);
+		void reset();
+
+		// Lines of "phase: calls, total and mean time" and "counter: value"
+		std::vector<std::string> getSummary() const;
+		bool writeTrace(const std::string& path) const;
+
+	// Implementation:
+	protected:
+		Profiler();
+
+		enum { maxPhases = 64 };
+		struct Phase
+		{
+			const char* name;
+			std::atomic<int64_t> calls;
+			std::atomic<int64_t> ns;
+		};
+		struct Event
+		{
+			int nPhase;
+			int nThread;
+			int64_t t0;
+			int64_t t1;
+		};
+
+		Phase m_phases[maxPhases];
+		std::atomic<int> m_nPhases;
+		std::atomic<int64_t> m_counters[maxCounter];
+		std::atomic<bool> m_bTrace;
+		mutable std::mutex m_mutex;
+		std::vector<Event> m_events;
+		std::chrono::steady_clock::time_point m_start;
+
+		static int getThreadIndex();
+	};
+	// End of Profiler
+	////////////////////////////////////////////////////////////////////////////////
+
+	// ProfScope - adds the time from its construction to its destruction to a phase
+	class ProfScope
+	{
+	public:
+		ProfScope(int nPhase) : m_nPhase(nPhase), m_t0(Profiler::get().now()) {}
+		~ProfScope() {
+			Profiler& p = Profiler::get();
+			p.add(m_nPhase, m_t0, p.now());
+		}
+
+	protected:
+		int m_nPhase;
+		int64_t m_t0;
+	};
+}
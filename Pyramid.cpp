@@ -0,0 +1,276 @@
+#include "pch.h"
+
+#include "Pyramid.h"
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Pyramid implementation
+	Pyramid::Pyramid() : blockSize(16), maxBuckets(64), threads(0), m_view(), m_nBlockSize(0), m_nBuckets(0), m_bOther(false),
+		m_nRecounted(0)
+	{
+	}
+
+	TypeId Pyramid::getBucketType(int bucket) const
+	{
+		return m_bOther && bucket == m_nBuckets - 1 ? (TypeId)StratTable::none : (TypeId)bucket;
+	}
+
+	Pyramid::Summary Pyramid::getSummary(int level, int row, int col) const
+	{
+		const uint32_t* pHist = getHistogram(level, row, col);
+		int best = 0;
+		for (int b = 1; b < m_nBuckets; b++)
+		{
+			if (pHist[b] > pHist[best])
+				best = b;
+		}
+
+		int size = getBlockSize(level);
+		int64_t rows = std::min((int64_t)(row + 1) * size, (int64_t)m_view.rows) - (int64_t)row * size;
+		int64_t cols = std::min((int64_t)(col + 1) * size, (int64_t)m_view.cols) - (int64_t)col * size;
+
+		Summary s;
+		s.dominant = getBucketType(best);
+		s.count = pHist[best];
+		s.cells = rows * cols;
+		s.meanScore = s.cells > 0 ? getScoreSum(level, row, col) / (double)s.cells : 0;
+		return s;
+	}
+
+	// Builtin ids always get buckets of their own, so that update() can spot the stochastic ones
+	int Pyramid::getBucketCount(const StratTable& strats) const
+	{
+		int nMax = std::max(maxBuckets, (int)Strat::Type::maxType);
+		int n = (int)Strat::Type::maxType;
+		while (n < strats.getCount() && n < nMax)
+			n *= 2;
+		return std::min(n, nMax);
+	}
+
+	void Pyramid::build(NzgNode& node)
+	{
+		NZG_PROF_SCOPE("Pyramid::build");
+		node.updateScores();
+		m_pool.setThreads(threads);
+		m_view = node.getView();
+		m_nBuckets = getBucketCount(node.strats);
+		m_bOther = node.strats.getCount() > m_nBuckets;
+		blockSize = std::max(blockSize, 1);
+		m_nBlockSize = blockSize;
+
+		m_levels.clear();
+		int rows = (m_view.rows + blockSize - 1) / blockSize;
+		int cols = (m_view.cols + blockSize - 1) / blockSize;
+		while (rows > 0 && cols > 0)
+		{
+			Level l;
+			l.rows = rows;
+			l.cols = cols;
+			l.hist.resize((size_t)rows * cols * m_nBuckets);
+			l.scores.resize((size_t)rows * cols);
+			l.dirty.assign((size_t)rows * cols, 0);
+			m_levels.push_back(std::move(l));
+			if (rows == 1 && cols == 1)
+				break;
+			rows = (rows + 1) / 2;
+			cols = (cols + 1) / 2;
+		}
+		if (m_levels.empty())
+			return;
+
+		Level& l0 = m_levels[0];
+		std::fill(l0.dirty.begin(), l0.dirty.end(), 1);
+		l0.dirtyBlocks.resize(l0.dirty.size());
+		for (size_t i = 0; i < l0.dirtyBlocks.size(); i++)
+			l0.dirtyBlocks[i] = (int)i;
+		recount();
+	}
+
+	void Pyramid::update(NzgNode& node)
+	{
+		NZG_PROF_SCOPE("Pyramid::update");
+		bool bComplete = node.takeChanges(m_changes);
+		node.updateScores();
+		GenView view = node.getView();
+
+		bool bStochastic = node.noise > 0;
+		if (!m_levels.empty())
+		{
+			const uint32_t* pTop = getHistogram(getLevels() - 1, 0, 0);
+			bStochastic |= pTop[(int)Strat::Type::friedman] > 0 || pTop[(int)Strat::Type::random] > 0;
+		}
+		if (!bComplete || bStochastic || m_levels.empty() || blockSize != m_nBlockSize ||
+			view.rows != m_view.rows || view.cols != m_view.cols ||
+			getBucketCount(node.strats) != m_nBuckets || (node.strats.getCount() > m_nBuckets) != m_bOther ||
+			m_changes.size() > m_levels[0].dirty.size())
+		{
+			// More changes than blocks leave few blocks clean, a build is cheaper
+			build(node);
+			return;
+		}
+
+		m_pool.setThreads(threads);
+		m_view = view;
+		int rows = view.rows;
+		int cols = view.cols;
+		for (int64_t nCell : m_changes)
+		{
+			int row = (int)(nCell / cols);
+			int col = (int)(nCell % cols);
+			for (int dr = -1; dr <= 1; dr++)
+			{
+				int r = row + dr < 0 ? rows - 1 : row + dr >= rows ? 0 : row + dr;
+				for (int dc = -1; dc <= 1; dc++)
+					markDirty(r, col + dc < 0 ? cols - 1 : col + dc >= cols ? 0 : col + dc);
+			}
+		}
+		recount();
+	}
+
+	void Pyramid::markDirty(int row, int col)
+	{
+		Level& l0 = m_levels[0];
+		int nBlock = row / blockSize * l0.cols + col / blockSize;
+		if (!l0.dirty[nBlock])
+		{
+			l0.dirty[nBlock] = 1;
+			l0.dirtyBlocks.push_back(nBlock);
+		}
+	}
+
+	void Pyramid::recount()
+	{
+		int nBuckets = m_nBuckets;
+		Level& l0 = m_levels[0];
+		m_nRecounted = (int64_t)l0.dirtyBlocks.size();
+		m_pool.parallelFor((int)l0.dirtyBlocks.size(), [&](int k0, int k1, int) {
+			for (int k = k0; k < k1; k++)
+			{
+				int nBlock = l0.dirtyBlocks[k];
+				int row0 = nBlock / l0.cols * blockSize;
+				int col0 = nBlock % l0.cols * blockSize;
+				int row1 = std::min(row0 + blockSize, m_view.rows);
+				int col1 = std::min(col0 + blockSize, m_view.cols);
+
+				uint32_t* pHist = l0.hist.data() + (size_t)nBlock * nBuckets;
+				std::fill(pHist, pHist + nBuckets, 0);
+				int64_t sum = 0;
+				for (int i = row0; i < row1; i++)
+				{
+					const TypeId* pTypes = m_view.types + (size_t)i * m_view.cols;
+					const int* pScores = m_view.scores + (size_t)i * m_view.cols;
+					for (int j = col0; j < col1; j++)
+					{
+						pHist[getBucket(pTypes[j])]++;
+						sum += pScores[j];
+					}
+				}
+				l0.scores[nBlock] = sum;
+			}
+		});
+
+		// Parents of the dirty blocks are the sums of their (up to) 4 children
+		for (size_t l = 1; l < m_levels.size(); l++)
+		{
+			Level& child = m_levels[l - 1];
+			Level& parent = m_levels[l];
+			for (int nBlock : child.dirtyBlocks)
+			{
+				child.dirty[nBlock] = 0;
+				int nParent = nBlock / child.cols / 2 * parent.cols + nBlock % child.cols / 2;
+				if (!parent.dirty[nParent])
+				{
+					parent.dirty[nParent] = 1;
+					parent.dirtyBlocks.push_back(nParent);
+				}
+			}
+			child.dirtyBlocks.clear();
+
+			m_pool.parallelFor((int)parent.dirtyBlocks.size(), [&](int k0, int k1, int) {
+				for (int k = k0; k < k1; k++)
+				{
+					int nBlock = parent.dirtyBlocks[k];
+					int row = nBlock / parent.cols;
+					int col = nBlock % parent.cols;
+					uint32_t* pHist = parent.hist.data() + (size_t)nBlock * nBuckets;
+					std::fill(pHist, pHist + nBuckets, 0);
+					int64_t sum = 0;
+					for (int i = 2 * row; i < std::min(2 * row + 2, child.rows); i++)
+					{
+						for (int j = 2 * col; j < std::min(2 * col + 2, child.cols); j++)
+						{
+							size_t nChild = (size_t)i * child.cols + j;
+							const uint32_t* pChild = child.hist.data() + nChild * nBuckets;
+							for (int b = 0; b < nBuckets; b++)
+								pHist[b] += pChild[b];
+							sum += child.scores[nChild];
+						}
+					}
+					parent.scores[nBlock] = sum;
+				}
+			});
+		}
+
+		Level& top = m_levels.back();
+		for (int nBlock : top.dirtyBlocks)
+			top.dirty[nBlock] = 0;
+		top.dirtyBlocks.clear();
+	}
+
+	void Pyramid::query(int row0, int col0, int row1, int col1, std::vector<int64_t>& hist, int64_t& scoreSum) const
+	{
+		hist.assign(m_nBuckets, 0);
+		scoreSum = 0;
+		int region[4] = { std::max(row0, 0), std::max(col0, 0), std::min(row1, m_view.rows), std::min(col1, m_view.cols) };
+		if (m_levels.empty() || region[0] >= region[2] || region[1] >= region[3])
+			return;
+		queryBlock(getLevels() - 1, 0, 0, region, hist, scoreSum);
+	}
+
+	void Pyramid::queryBlock(int level, int row, int col, const int* region, std::vector<int64_t>& hist, int64_t& scoreSum) const
+	{
+		const Level& l = m_levels[level];
+		if (row >= l.rows || col >= l.cols)
+			return;
+
+		int size = getBlockSize(level);
+		int row0 = std::max(row * size, region[0]);
+		int col0 = std::max(col * size, region[1]);
+		int row1 = (int)std::min({ (int64_t)(row + 1) * size, (int64_t)region[2], (int64_t)m_view.rows });
+		int col1 = (int)std::min({ (int64_t)(col + 1) * size, (int64_t)region[3], (int64_t)m_view.cols });
+		if (row0 >= row1 || col0 >= col1)
+			return;
+
+		bool bInside = row0 == row * size && col0 == col * size &&
+			row1 == std::min((row + 1) * size, m_view.rows) && col1 == std::min((col + 1) * size, m_view.cols);
+		if (bInside)
+		{
+			const uint32_t* pHist = getHistogram(level, row, col);
+			for (int b = 0; b < m_nBuckets; b++)
+				hist[b] += pHist[b];
+			scoreSum += getScoreSum(level, row, col);
+		}
+		else if (level == 0)
+		{
+			for (int i = row0; i < row1; i++)
+			{
+				for (int j = col0; j < col1; j++)
+				{
+					hist[getBucket(m_view.type(i, j))]++;
+					scoreSum += m_view.score(i, j);
+				}
+			}
+		}
+		else
+		{
+			for (int i = 2 * row; i < 2 * row + 2; i++)
+			{
+				for (int j = 2 * col; j < 2 * col + 2; j++)
+					queryBlock(level - 1, i, j, region, hist, scoreSum);
+			}
+		}
+	}
+	// End of Pyramid implementation
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+}
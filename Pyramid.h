@@ -0,0 +1,96 @@
+#pragma once
+
+#include "NzgNode.h"
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////
+	// Pyramid - coarse summaries of the map for zoomed out views and region queries:
+	// type histograms and score sums of blocks of blockSize x blockSize cells (level 0),
+	// of 2x2 of those (level 1) and so on up to a single block for the whole map.
+	//
+	// update() takes the changed cells from NzgNode::takeChanges() (turn trackChanges
+	// on): a change touches the type of one block and the scores of the blocks of its
+	// 3x3 neighbourhood, and only these are recounted, then their parents up the levels.
+	// Noise and the stochastic types move every score every generation, with them (or
+	// when the record of changes gave out) everything is rebuilt.
+	//
+	// Histograms are by type id, up to maxBuckets; on maps with more ids the last
+	// bucket holds all the higher ones and has no type (StratTable::none).
+	class Pyramid
+	{
+	// Construction:
+	public:
+		Pyramid();
+
+		struct Summary
+		{
+			TypeId dominant;	// Type most cells hold, the lowest id of a tie
+			int64_t count;		// Cells of the dominant type
+			int64_t cells;
+			double meanScore;
+		};
+
+	// Attributes:
+	public:
+		int blockSize;	// Cells along either side of a level 0 block
+		int maxBuckets;
+		int threads;	// 0 for all hardware threads
+
+		int getLevels() const { return (int)m_levels.size(); }
+		int getBlockRows(int level) const { return m_levels[level].rows; }
+		int getBlockCols(int level) const { return m_levels[level].cols; }
+		int getBlockSize(int level) const { return blockSize << level; } // Cells along a side
+		int getBuckets() const { return m_nBuckets; }
+		TypeId getBucketType(int bucket) const;
+		const uint32_t* getHistogram(int level, int row, int col) const {
+			return m_levels[level].hist.data() + ((size_t)row * m_levels[level].cols + col) * m_nBuckets;
+		}
+		int64_t getScoreSum(int level, int row, int col) const {
+			return m_levels[level].scores[(size_t)row * m_levels[level].cols + col];
+		}
+		Summary getSummary(int level, int row, int col) const;
+		int64_t getRecounted() const { return m_nRecounted; } // Level 0 blocks recounted by the last update
+
+	// Operations:
+	public:
+		void build(NzgNode& node); // Replays the scores of the node if they are stale
+		// Brings the pyramid up to the node from the changes it recorded since the last call
+		void update(NzgNode& node);
+		// Histogram by bucket and score sum of the cells [row0, row1) x [col0, col1), from the
+		// coarsest blocks inside and the cells of the fringe. The blocks hold the map of the
+		// last update, the fringe is read from the live planes of the node, so the two agree
+		// only until the node moves on: query between update() and the next step or edit.
+		void query(int row0, int col0, int row1, int col1, std::vector<int64_t>& hist, int64_t& scoreSum) const;
+
+	// Implementation:
+	protected:
+		struct Level
+		{
+			int rows;
+			int cols;
+			std::vector<uint32_t> hist;		// m_nBuckets per block
+			std::vector<int64_t> scores;
+			std::vector<uint8_t> dirty;
+			std::vector<int> dirtyBlocks;	// Indices of the blocks marked dirty
+		};
+		std::vector<Level> m_levels;
+		GenView m_view;
+		int m_nBlockSize;	// blockSize of the last build
+		int m_nBuckets;
+		bool m_bOther;	// The last bucket holds the ids from m_nBuckets - 1 on
+		ThreadPool m_pool;
+		std::vector<int64_t> m_changes;
+		int64_t m_nRecounted;
+
+		int getBucket(TypeId type) const {
+			return m_bOther && type >= m_nBuckets - 1 ? m_nBuckets - 1 : type;
+		}
+		int getBucketCount(const StratTable& strats) const;
+		void markDirty(int row, int col); // Level 0 block of a cell
+		void recount(); // Dirty level 0 blocks from the planes, and their parents
+		void queryBlock(int level, int row, int col, const int* region, std::vector<int64_t>& hist, int64_t& scoreSum) const;
+	};
+	// End of Pyramid
+	////////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////
+	// Rng - small fast generator (xoshiro256**) for the simulation hot loops.
+	// std::rand() is too slow and too short for per-cell sampling on big grids.
+	class Rng
+	{
+	// Construction:
+	public:
+		Rng() {
+			seed(0x9E3779B97F4A7C15ull);
+		}
+		Rng(uint64_t s) {
+			seed(s);
+		}
+		void seed(uint64_t s) {
+			// Expand the seed with splitmix64 so that close seeds give unrelated streams
+			for (int i = 0; i < 4; i++)
+			{
+				s += 0x9E3779B97F4A7C15ull;
+				uint64_t z = s;
+				z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+				z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+				st[i] = z ^ (z >> 31);
+			}
+		}
+
+		// Stream number stream of seed s, for the tasks of a parallel loop to draw the
+		// same numbers whichever thread runs them
+		void seed(uint64_t s, uint64_t stream) {
+			uint64_t z = s ^ (stream + 1) * 0xD1B54A32D192ED03ull;
+			z = (z ^ (z >> 32)) * 0xBF58476D1CE4E5B9ull;
+			seed(z ^ (z >> 29));
+		}
+
+		// Raw state, for checkpoints
+		void getState(uint64_t state[4]) const {
+			for (int i = 0; i < 4; i++)
+				state[i] = st[i];
+		}
+		void setState(const uint64_t state[4]) {
+			for (int i = 0; i < 4; i++)
+				st[i] = state[i];
+		}
+
+	// Operations:
+	public:
+		uint64_t next() {
+			uint64_t r = rotl(st[1] * 5, 7) * 9;
+			uint64_t t = st[1] << 17;
+			st[2] ^= st[0];
+			st[3] ^= st[1];
+			st[1] ^= st[2];
+			st[0] ^= st[3];
+			st[2] ^= t;
+			st[3] = rotl(st[3], 45);
+			return r;
+		}
+
+		// Uniform integer in [0, n) (Lemire's multiply-shift with rejection)
+		uint32_t below(uint32_t n) {
+			uint64_t m = (next() >> 32) * n;
+			uint32_t l = (uint32_t)m;
+			if (l < n)
+			{
+				uint32_t t = (0u - n) % n;
+				while (l < t)
+				{
+					m = (next() >> 32) * n;
+					l = (uint32_t)m;
+				}
+			}
+			return (uint32_t)(m >> 32);
+		}
+
+		// Uniform integer in [0, n) for any n, the same draws as below() when n < 2^32
+		uint64_t below64(uint64_t n) {
+			if (n <= 0xFFFFFFFFull)
+				return below((uint32_t)n);
+			// Masked rejection, at most two draws expected
+			uint64_t mask = n - 1;
+			for (int k = 1; k < 64; k <<= 1)
+				mask |= mask >> k;
+			uint64_t r;
+			do
+			{
+				r = next() & mask;
+			} while (r >= n);
+			return r;
+		}
+
+		// Uniform double in [0, 1)
+		double uniform() {
+			return (next() >> 11) * (1.0 / 9007199254740992.0);
+		}
+
+		// Fill out[0..n) with uniform floats in [0, 1), two 24 bit values per draw
+		void fill(float* out, int n) {
+			int i = 0;
+			for (; i + 1 < n; i += 2)
+			{
+				uint64_t r = next();
+				out[i] = (uint32_t)(r >> 40) * (1.0f / 16777216.0f);
+				out[i + 1] = (uint32_t)((r >> 8) & 0xFFFFFF) * (1.0f / 16777216.0f);
+			}
+			if (i < n)
+				out[i] = (uint32_t)(next() >> 40) * (1.0f / 16777216.0f);
+		}
+
+		// Fill out[0..n) with uniform integers in [0, 2^bits), bits <= 8,
+		// using every bit of each draw
+		void fillBits(uint8_t* out, int n, int bits) {
+			uint8_t mask = (uint8_t)((1 << bits) - 1);
+			int perDraw = 64 / bits;
+			int i = 0;
+			while (i < n)
+			{
+				uint64_t r = next();
+				for (int k = 0; k < perDraw && i < n; k++, i++)
+				{
+					out[i] = (uint8_t)(r & mask);
+					r >>= bits;
+				}
+			}
+		}
+
+	// Implementation:
+	protected:
+		uint64_t st[4];
+
+		static uint64_t rotl(uint64_t x, int k) {
+			return (x << k) | (x >> (64 - k));
+		}
+	};
+	// End of Rng
+	////////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,203 @@
+#include "pch.h"
+
+#include "Replicator.h"
+
+namespace nzg
+{
+	namespace
+	{
+		// Dormand-Prince 5(4) tableau; the last stage is at the new point
+		const double c_a[7][6] = {
+			{ 0 },
+			{ 1.0 / 5 },
+			{ 3.0 / 40, 9.0 / 40 },
+			{ 44.0 / 45, -56.0 / 15, 32.0 / 9 },
+			{ 19372.0 / 6561, -25360.0 / 2187, 64448.0 / 6561, -212.0 / 729 },
+			{ 9017.0 / 3168, -355.0 / 33, 46732.0 / 5247, 49.0 / 176, -5103.0 / 18656 },
+			{ 35.0 / 384, 0, 500.0 / 1113, 125.0 / 192, -2187.0 / 6784, 11.0 / 84 }
+		};
+		// Difference of the 5th and 4th order weights
+		const double c_e[7] = {
+			71.0 / 57600, 0, -71.0 / 16695, 71.0 / 1920, -17253.0 / 339200, 22.0 / 525, -1.0 / 40
+		};
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Replicator implementation
+	Replicator::Replicator() : rtol(1e-6), atol(1e-9), maxSteps(100000), m_t(0), m_h(0), m_nSteps(0), m_nRejected(0)
+	{
+	}
+
+	void Replicator::setPayoffs(StratTable& table, const std::vector<TypeId>& types, int nSamples)
+	{
+		m_types = types;
+		size_t n = types.size();
+		m_a.assign(n * n, 0);
+		Rng rng; // The same samples on every call
+		for (size_t i = 0; i < n; i++)
+		{
+			for (size_t j = 0; j < n; j++)
+			{
+				int s1, s2;
+				if (table.get(types[i]).isDeterministic() && table.get(types[j]).isDeterministic())
+				{
+					table.match(types[i], types[j], s1, s2, rng);
+					m_a[i * n + j] = s1;
+					continue;
+				}
+
+				Strat st1 = table.get(types[i]);
+				Strat st2 = table.get(types[j]);
+				double sum = 0;
+				for (int k = 0; k < std::max(nSamples, 1); k++)
+				{
+					StratTable::simulate(st1, st2, s1, s2, rng);
+					sum += s1;
+				}
+				m_a[i * n + j] = sum / std::max(nSamples, 1);
+			}
+		}
+		for (double& a : m_a)
+			a /= StratTable::c_rounds;
+
+		m_x.assign(n, n > 0 ? 1.0 / n : 0);
+		m_t = 0;
+		m_h = 0;
+	}
+
+	void Replicator::setShares(const std::vector<double>& shares)
+	{
+		double sum = 0;
+		for (size_t i = 0; i < m_x.size(); i++)
+			sum += i < shares.size() ? std::max(shares[i], 0.0) : 0;
+		for (size_t i = 0; i < m_x.size(); i++)
+			m_x[i] = sum > 0 && i < shares.size() ? std::max(shares[i], 0.0) / sum : 0;
+		m_t = 0;
+		m_h = 0;
+	}
+
+	void Replicator::setShares(const NzgNode& node)
+	{
+		std::vector<int64_t> counts(node.strats.getCount(), 0);
+		const TypeId* pTypes = node.sts.getTypes();
+		for (int64_t i = 0; i < node.sts.getSize(); i++)
+			counts[pTypes[i]]++;
+
+		std::vector<double> shares(m_types.size());
+		for (size_t i = 0; i < m_types.size(); i++)
+			shares[i] = m_types[i] < counts.size() ? (double)counts[m_types[i]] : 0;
+		setShares(shares);
+	}
+
+	void Replicator::rates(const double* x, double* dx)
+	{
+		size_t n = m_types.size();
+		double mean = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			const double* pRow = m_a.data() + i * n;
+			double f = 0;
+			for (size_t j = 0; j < n; j++)
+				f += pRow[j] * x[j];
+			m_ax[i] = f;
+			mean += x[i] * f;
+		}
+		for (size_t i = 0; i < n; i++)
+			dx[i] = x[i] * (m_ax[i] - mean);
+	}
+
+	bool Replicator::run(double duration, int nSamples)
+	{
+		NZG_PROF_SCOPE("Replicator::run");
+		size_t n = m_types.size();
+		for (auto& k : m_k)
+			k.resize(n);
+		m_y.resize(n);
+		m_ax.resize(n);
+		m_times.clear();
+		m_samples.clear();
+		m_nSteps = 0;
+		m_nRejected = 0;
+
+		if (m_h <= 0)
+			m_h = std::min(0.1, duration / std::max(nSamples, 1));
+		rates(m_x.data(), m_k[0].data());
+
+		double t0 = m_t;
+		for (int s = 1; s <= nSamples; s++)
+		{
+			double tSample = t0 + duration * s / nSamples;
+			while (tSample - m_t > 1e-12 * std::max(1.0, std::abs(tSample)))
+			{
+				if (m_nSteps >= maxSteps || !step(tSample - m_t))
+					return false;
+			}
+			// The last step ends exactly on the sample
+			m_t = tSample;
+			m_times.push_back(m_t);
+			m_samples.insert(m_samples.end(), m_x.begin(), m_x.end());
+		}
+		return true;
+	}
+
+	// One accepted step of at most hMax, retrying with smaller steps while the error is too big
+	bool Replicator::step(double hMax)
+	{
+		size_t n = m_types.size();
+		for (;;)
+		{
+			m_nSteps++;
+			double h = std::min(m_h, hMax);
+			for (int s = 1; s < 7; s++)
+			{
+				for (size_t i = 0; i < n; i++)
+				{
+					double y = m_x[i];
+					for (int r = 0; r < s; r++)
+						y += h * c_a[s][r] * m_k[r][i];
+					m_y[i] = y;
+				}
+				rates(m_y.data(), m_k[s].data());
+			}
+
+			// m_y holds the 5th order solution now
+			double err = 0;
+			for (size_t i = 0; i < n; i++)
+			{
+				double e = 0;
+				for (int s = 0; s < 7; s++)
+					e += c_e[s] * m_k[s][i];
+				double scale = atol + rtol * std::max(std::abs(m_x[i]), std::abs(m_y[i]));
+				err += (h * e / scale) * (h * e / scale);
+			}
+			err = n > 0 ? std::sqrt(err / n) : 0;
+
+			double factor = err > 0 ? 0.9 * std::pow(err, -0.2) : 5;
+			if (!(err <= 1))
+			{
+				m_nRejected++;
+				m_h = h * std::max(0.2, std::min(1.0, factor));
+				if (m_h < 1e-12 || m_nSteps >= maxSteps)
+					return false;
+				continue;
+			}
+
+			// Back onto the simplex, off it the rates no longer keep the sum
+			double sum = 0;
+			for (size_t i = 0; i < n; i++)
+				sum += m_y[i] = std::max(m_y[i], 0.0);
+			for (size_t i = 0; i < n; i++)
+				m_y[i] /= sum;
+
+			m_t += h;
+			m_x.swap(m_y);
+			rates(m_x.data(), m_k[0].data());
+			// Proposals are not cut short by the distance to the next sample
+			if (h >= m_h)
+				m_h = h * std::max(0.2, std::min(5.0, factor));
+			return true;
+		}
+	}
+	// End of Replicator implementation
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "NzgNode.h"
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////
+	// Replicator - mean field of the spatial game: the replicator equation of a well
+	// mixed population, dx_i/dt = x_i ((A x)_i - x'A x), over the payoff matrix of the
+	// matches NzgNode::play() plays. Integrated by the Dormand-Prince 5(4) pair with
+	// step size control; a run of the built-in types takes microseconds.
+	// Payoffs are per round, so a time unit is a round's worth of selection.
+	class Replicator
+	{
+	// Construction:
+	public:
+		Replicator();
+
+		// Payoffs of the types against each other; matches with a stochastic strategy are
+		// averaged over nSamples plays
+		void setPayoffs(StratTable& table, const std::vector<TypeId>& types, int nSamples = 64);
+		// Shares of the types, scaled to sum 1
+		void setShares(const std::vector<double>& shares);
+		// Shares of the types on the map of the node
+		void setShares(const NzgNode& node);
+
+	// Attributes:
+	public:
+		double rtol;	// Tolerances of the local error of a step
+		double atol;
+		int maxSteps;
+
+		int getTypeCount() const { return (int)m_types.size(); }
+		const std::vector<TypeId>& getTypes() const { return m_types; }
+		double getPayoff(int i, int j) const { return m_a[(size_t)i * m_types.size() + j]; }
+		const std::vector<double>& getShares() const { return m_x; }
+		double getTime() const { return m_t; }
+		int getSteps() const { return m_nSteps; } // Accepted and rejected steps of the last run
+		int getRejected() const { return m_nRejected; }
+
+		// Trajectory of the last run: sample k at time getSampleTime(k)
+		int getSampleCount() const { return (int)m_times.size(); }
+		double getSampleTime(int k) const { return m_times[k]; }
+		const double* getSample(int k) const { return m_samples.data() + (size_t)k * m_types.size(); }
+
+	// Operations:
+	public:
+		// Integrates from the current time for duration, sampling the shares nSamples times
+		// at equal intervals after the start. Returns false if maxSteps ran out first.
+		bool run(double duration, int nSamples);
+
+	// Implementation:
+	protected:
+		std::vector<TypeId> m_types;
+		std::vector<double> m_a;	// Row major payoff per round of type i against type j
+		std::vector<double> m_x;
+		double m_t;
+		double m_h;					// Step size the control proposes next
+		int m_nSteps;
+		int m_nRejected;
+		std::vector<double> m_times;
+		std::vector<double> m_samples;
+		std::vector<double> m_k[7];	// Stages of the Dormand-Prince step
+		std::vector<double> m_y;
+		std::vector<double> m_ax;
+
+		void rates(const double* x, double* dx);
+		bool step(double hMax);
+	};
+	// End of Replicator
+	////////////////////////////////////////////////////////////////////////////////
+}
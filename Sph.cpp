@@ -36,6 +36,7 @@
 
 #include "Sph.h"
 #include "Tools.h"
+#include "NormalEqs.h"
 
 
 /////////////////////////////////////////////////////////////
@@ -193,6 +194,72 @@ double SphericalHarmonics::Y(int l, int m, double theta, double phi) const
 		return sqrt2 * K(l, -m) * ::sin(-m * phi) * P(l, -m, m_dK * ::cos(theta) + m_dH);
 }
 
+void SphericalHarmonics::getY(int nBands, int mBands, double theta, double phi, std::vector<double>& ys) const
+{
+	// K(l, m) * P(l, m, x) by the normalized recurrences, first along the diagonal
+	//   Pmm = -sqrt((2m + 1) / 2m) * sqrt(1 - x^2) * P(m-1)(m-1)
+	// then up l
+	//   Plm = a(l, m) * (x * P(l-1)m - P(l-2)m / a(l-1, m)), a(l, m) = sqrt((4l^2 - 1) / (l^2 - m^2))
+	// with cos(m * phi) and sin(m * phi) by the Chebyshev recurrence
+	mBands = std::min(mBands, nBands);
+	ys.resize(std::max(ShProjection::getSize(nBands, mBands), 0));
+	if (nBands <= 0 || mBands <= 0)
+		return;
+
+	const double sqrt2 = ::sqrt(2.0);
+	double x = m_dK * ::cos(theta) + m_dH;
+	double somx2 = ::sqrt((1 - x) * (1 + x));
+	double cos1 = ::cos(phi);
+	double sin1 = ::sin(phi);
+
+	double pmm = ::sqrt(1 / (4 * PI));
+	double cosm = 1;
+	double sinm = 0;
+	double cosPrev = cos1; // cos((m - 1) * phi)
+	double sinPrev = -sin1;
+	for (int m = 0; m < mBands; m++)
+	{
+		if (m > 0)
+		{
+			pmm *= -::sqrt((2 * m + 1) / (2.0 * m)) * somx2;
+			double c = 2 * cos1 * cosm - cosPrev;
+			double s = 2 * cos1 * sinm - sinPrev;
+			cosPrev = cosm;
+			sinPrev = sinm;
+			cosm = c;
+			sinm = s;
+		}
+
+		double plm2 = 0;
+		double plm1 = 0;
+		double aPrev = 1;
+		for (int l = m; l < nBands; l++)
+		{
+			double plm = pmm;
+			if (l > m)
+			{
+				double a = ::sqrt((4.0 * l * l - 1) / ((double)l * l - (double)m * m));
+				plm = a * (x * plm1 - plm2 / aPrev);
+				aPrev = a;
+			}
+			plm2 = plm1;
+			plm1 = plm;
+
+			// Index of (l, 0)
+			int nIndex = l < mBands ? l * (l + 1) : mBands * mBands + (l - mBands) * (2 * mBands - 1) + mBands - 1;
+			if (m == 0)
+			{
+				ys[nIndex] = plm;
+			}
+			else
+			{
+				ys[nIndex + m] = sqrt2 * plm * cosm;
+				ys[nIndex - m] = sqrt2 * plm * sinm;
+			}
+		}
+	}
+}
+
 void SphericalHarmonics::getLegendreDerivarives(int m, int lMax, double theta, std::vector<double>& ders, std::vector<int>& ls) const
 {
 	ders.resize(0);
@@ -420,6 +487,8 @@ ShProjection::ShProjection()
 	m_nBands = 0;
 	m_mBands = 0;
 	m_sigma = 0;
+	m_dLogDet = NAN;
+	m_dCondition = NAN;
 }
 
 ShProjection::~ShProjection()
@@ -450,6 +519,8 @@ void ShProjection::setBands(int nBands, int mBands, double dEleMaskDeg)
 	m_q.resize(nCoefs, nCoefs);
 	m_q.init(0);
 	m_sigma = 0.0;
+	m_dLogDet = NAN;
+	m_dCondition = NAN;
 }
 
 void ShProjection::setBands(int nBands, int mBands, const SphericalHarmonics& sp)
@@ -469,6 +540,8 @@ void ShProjection::setBands(int nBands, int mBands, const SphericalHarmonics& sp
 	m_q.resize(nCoefs, nCoefs);
 	m_q.init(0);
 	m_sigma = 0.0;
+	m_dLogDet = NAN;
+	m_dCondition = NAN;
 }
 
 bool ShProjection::canEvaluate() const
@@ -508,34 +581,24 @@ double ShProjection::getCoef(int l, int m) const
 
 void ShProjection::getYmn(Vector& Y, double theta, double phi) const
 {
+	std::vector<double> ys;
+	m_sph.getY(m_nBands, m_mBands, theta, phi, ys);
 	Y.resize(getSize());
-
-	for (int l = 0; l < m_nBands; l++)
+	for (int i = 0; i < (int)ys.size(); i++)
 	{
-		for (int m = -std::min(l, m_mBands - 1); m <= std::min(l, m_mBands - 1); m++)
-		{
-			int nIndex = getIndex(l, m);
-
-			double d = m_sph.Y(l, m, theta, phi);
-			Y[nIndex] = d;
-		}
+		Y[i] = ys[i];
 	}
 }
 
 void ShProjection::getY0n(Vector& Y, double theta) const
 {
+	// With one m band the harmonics are Y(l, 0) in order of l
+	std::vector<double> ys;
+	m_sph.getY(m_nBands, 1, theta, 0, ys);
 	Y.resize(m_nBands);
-
 	for (int l = 0; l < m_nBands; l++)
 	{
-		//for (int m = -min(l, m_mBands - 1); m <= min(l, m_mBands - 1); m++)
-		int m = 0;
-		{
-			//int nIndex = getIndex(l, m);
-
-			double d = m_sph.Y(l, m, theta, 0);
-			Y[l] = d;
-		}
+		Y[l] = ys[l];
 	}
 }
 
@@ -614,6 +677,8 @@ ShProjection& ShProjection::operator=(const ShProjection& a)
 	}
 	m_q = a.m_q;
 	m_sigma = a.m_sigma;
+	m_dLogDet = a.m_dLogDet;
+	m_dCondition = a.m_dCondition;
 
 	return *this;
 }
@@ -658,54 +723,54 @@ void ShProjection::project(ShFunction& shf, int nBands, int mBands)
 	B.init(0);
 	Vector X(nCoefs);
 
-	for (int j = 0; j < shf.getMeasCount(); j++)
+	// The measurements are read in order, the harmonics are evaluated and summed in
+	// parallel (NormalEqs)
+	int nMeas = shf.getMeasCount();
+	std::vector<double> thetas(nMeas), fis(nMeas), meas(nMeas);
+	for (int j = 0; j < nMeas; j++)
 	{
-		double theta = 0;
-		double fi = 0;
-		double dMeas = shf.getMeas(j, &theta, &fi);
-		if (_isnan(dMeas))
-			continue;
-
-		for (int l = 0; l < m_nBands; l++)
-		{
-			for (int m = -std::min(l, m_mBands - 1); m <= std::min(l, m_mBands - 1); m++)
-			{
-				//int nIndex1 = l < m_mBands ? l * (l+1) + m : 
-				//	m_mBands * m_mBands + (l - m_mBands) * (2*m_mBands - 1) + (m + m_mBands - 1);
-				int nIndex1 = getIndex(l, m);
-
-				double f1 = m_sph.Y(l, m, theta, fi);
-				B[nIndex1] += dMeas * f1;
-				for (int p = 0; p < m_nBands; p++)
-				{
-					for (int q = -std::min(p, m_mBands - 1); q <= std::min(p, m_mBands - 1); q++)
-					{
-						//int nIndex2 = p < m_mBands ? p * (p+1) + q :
-						//	m_mBands * m_mBands + (p - m_mBands) * (2 * m_mBands - 1) + (q + m_mBands - 1);
-						int nIndex2 = getIndex(p, q);
+		meas[j] = shf.getMeas(j, &thetas[j], &fis[j]);
+	}
 
-						double f2 = m_sph.Y(p, q, theta, fi);
+	NormalEqs& eqs = NormalEqs::getLocal();
+	eqs.accumulate(nCoefs, nMeas, [&](int j, double* row, double& value, double& weight) {
+		if (_isnan(meas[j]))
+			return false;
 
-						A(nIndex1, nIndex2) += f1 * f2;
-						//A(nIndex2, nIndex1) = A(nIndex1, nIndex2);
-					}
-				}
-			}
-		}
-	}
+		thread_local std::vector<double> ys;
+		m_sph.getY(m_nBands, m_mBands, thetas[j], fis[j], ys);
+		std::copy(ys.begin(), ys.end(), row);
+		value = meas[j];
+		weight = 1;
+		return true;
+	}, A, B);
 
-	//A.CopyUpperTriangle();
+	A.copyUpperTriangle();
 	//A.fileDump("test.txt", B, "shp", TRUE);
-	X = A.solve(B);
+	// The normal matrix is positive definite unless the measurements don't determine
+	// all the coefficients; then the general solve is left to report it
+	Cholesky chol;
+	if (chol.factor(A))
+	{
+		X = chol.solve(B);
+		chol.inverse(m_q);
+		m_dLogDet = chol.getLogDet();
+		m_dCondition = chol.getCondition();
+	}
+	else
+	{
+		X = A.solve(B);
+		m_q = A;
+		m_q.inverse();
+		m_dLogDet = NAN;
+		m_dCondition = INFINITY;
+	}
 
 	for (int i = 0; i < nCoefs; i++)
 	{
 		m_coefs[i] = X[i];
 	}
 
-	m_q = A;
-	m_q.inverse();
-
 	double dSum = 0;
 	for (int j = 0; j < shf.getMeasCount(); j++)
 	{
@@ -760,38 +825,12 @@ void ShProjection::appendEqs(double ele, double az, double dRotAngle, double dPh
 {
 	double theta = (90 - ele) * PI / 180;
 	double fi = (90 - az) * PI / 180;
+	thread_local std::vector<double> ys; // Per thread, the updates allocate nothing once it has grown
+	m_sph.getY(m_nBands, m_mBands, theta, fi, ys);
 
-	for (int l = 0; l < m_nBands; l++)
-	{
-		for (int m = -std::min(l, m_mBands - 1); m <= std::min(l, m_mBands - 1); m++)
-		{
-			//int nIndex1 = l * (l+1) + m;
-			//int nIndex1 = l < m_mBands ? l * (l + 1) + m :
-			//	m_mBands * m_mBands + (l - m_mBands) * (2 * m_mBands - 1) + (m + m_mBands - 1);
-			int nIndex1 = getIndex(l, m);
-
-			double f1 = m_sph.Y(l, m, theta, fi);
-			U[nIndex1] += weight * dPh * f1;
-			for (int p = 0; p < m_nBands; p++)
-			{
-				for (int q = -std::min(p, m_mBands - 1); q <= std::min(p, m_mBands - 1); q++)
-				{
-					//int nIndex2 = p * (p+1) + q;
-					//int nIndex2 = p < m_mBands ? p * (p + 1) + q :
-					//	m_mBands * m_mBands + (p - m_mBands) * (2 * m_mBands - 1) + (q + m_mBands - 1);
-					int nIndex2 = getIndex(p, q);
-
-					if (nIndex2 > nIndex1)
-						continue;
-
-					double f2 = m_sph.Y(p, q, theta, fi);
-
-					N(nIndex2, nIndex1) += weight * f1 * f2;
-					//N(nIndex1, nIndex2) = N(nIndex2, nIndex1);
-				}
-			}
-		}
-	}
+	// Upper triangle of N only
+	N.syr(weight, ys.data(), (int)ys.size());
+	U.axpy(weight * dPh, ys.data(), (int)ys.size());
 }
 
 void ShProjection::appendEqs(double ele, double az, double dPh, double weight, Matrix& N, Vector& U) const
@@ -804,31 +843,11 @@ void ShProjection::appendEqs2(double ele, double az, double dPh, double weight,
 	double theta = (90 - ele) * PI / 180;
 	double phid = 90 - az;
 	double fi = phid * PI / 180;
+	thread_local std::vector<double> ys;
+	m_sph.getY(m_nBands, m_mBands, theta, fi, ys);
 
-	for (int l = 0; l < m_nBands; l++)
-	{
-		for (int m = -std::min(l, m_mBands - 1); m <= std::min(l, m_mBands - 1); m++)
-		{
-			int nIndex1 = getIndex(l, m);
-
-			double f1 = m_sph.Y(l, m, theta, fi);
-			U[nIndex1] += weight * dPh * f1;
-			for (int p = 0; p < m_nBands; p++)
-			{
-				for (int q = -std::min(p, m_mBands - 1); q <= std::min(p, m_mBands - 1); q++)
-				{
-					int nIndex2 = getIndex(p, q);
-
-					if (nIndex2 > nIndex1)
-						continue;
-
-					double f2 = m_sph.Y(p, q, theta, fi);
-
-					N(nIndex2, nIndex1) += weight * f1 * f2;
-				}
-			}
-		}
-	}
+	N.syr(weight, ys.data(), (int)ys.size());
+	U.axpy(weight * dPh, ys.data(), (int)ys.size());
 }
 
 void ShProjection::appendEqs(const ZenAz& za, double dPh, double weight, Matrix& N, Vector& U) const
@@ -836,36 +855,12 @@ void ShProjection::appendEqs(const ZenAz& za, double dPh, double weight, Matrix&
 	double theta = za.zen * PI / 180;
 	double phid = 90 - za.az;
 	double fi = phid * PI / 180;
+	thread_local std::vector<double> ys;
+	m_sph.getY(m_nBands, m_mBands, theta, fi, ys);
 
-	for (int l = 0; l < m_nBands; l++)
-	{
-		for (int m = -std::min(l, m_mBands - 1); m <= std::min(l, m_mBands - 1); m++)
-		{
-			int nIndex1 = getIndex(l, m);
-			if (nIndex1 < 0)
-				continue;
-
-			double f1 = m_sph.Y(l, m, theta, fi);
-			U[nIndex1] += weight * dPh * f1;
-			for (int p = 0; p < m_nBands; p++)
-			{
-				for (int q = -std::min(p, m_mBands - 1); q <= std::min(p, m_mBands - 1); q++)
-				{
-					int nIndex2 = getIndex(p, q);
-					if (nIndex2 < 0)
-						continue;
-
-					if (nIndex2 > nIndex1)
-						continue;
-
-					double f2 = m_sph.Y(p, q, theta, fi);
-
-					N(nIndex2, nIndex1) += weight * f1 * f2;
-					N(nIndex1, nIndex2) = N(nIndex2, nIndex1);
-				}
-			}
-		}
-	}
+	// Upper triangle of N only
+	N.syr(weight, ys.data(), (int)ys.size());
+	U.axpy(weight * dPh, ys.data(), (int)ys.size());
 }
 
 void ShProjection::appendEqsSemi(const ZenAz& za, double dPh, double weight, Matrix& N, Vector& U) const
@@ -873,36 +868,26 @@ void ShProjection::appendEqsSemi(const ZenAz& za, double dPh, double weight, Mat
 	double theta = za.zen * PI / 180;
 	double phid = 90 - za.az;
 	double fi = phid * PI / 180;
+	thread_local std::vector<double> ys;
+	m_sph.getY(m_nBands, m_mBands, theta, fi, ys);
 
+	// Harmonics of even l + m at their semi indices, the others stay 0
+	int nSemi = getSemiSize();
+	thread_local std::vector<double> xs;
+	xs.assign(nSemi, 0.0);
 	for (int l = 0; l < m_nBands; l++)
 	{
 		for (int m = -std::min(l, m_mBands - 1); m <= std::min(l, m_mBands - 1); m++)
 		{
-			int nIndex1 = getSemiIndex(l, m);
-			if (nIndex1 < 0)
-				continue;
-
-			double f1 = m_sph.Y(l, m, theta, fi);
-			U[nIndex1] += weight * dPh * f1;
-			for (int p = 0; p < m_nBands; p++)
-			{
-				for (int q = -std::min(p, m_mBands - 1); q <= std::min(p, m_mBands - 1); q++)
-				{
-					int nIndex2 = getSemiIndex(p, q);
-					if (nIndex2 < 0)
-						continue;
-
-					if (nIndex2 > nIndex1)
-						continue;
-
-					double f2 = m_sph.Y(p, q, theta, fi);
-
-					N(nIndex2, nIndex1) += weight * f1 * f2;
-					N(nIndex1, nIndex2) = N(nIndex2, nIndex1);
-				}
-			}
+			int nIndex = getSemiIndex(l, m);
+			if (nIndex >= 0)
+				xs[nIndex] = ys[getIndex(l, m)];
 		}
 	}
+
+	// Upper triangle of N only
+	N.syr(weight, xs.data(), nSemi);
+	U.axpy(weight * dPh, xs.data(), nSemi);
 }
 
 void ShProjection::setCoefs(Vector& X)
@@ -938,6 +923,8 @@ void ShProjection::setSemiCoefs(Vector& X)
 double ShProjection::pcc(const ThetaPhi& tp, const ShProjection::UseHarms* pUseHarms) const
 {
 	double result = 0.0;
+	std::vector<double> ys;
+	m_sph.getY(m_nBands, m_mBands, tp.theta, tp.phi, ys);
 
 	for (int l = 0; l < m_nBands; l++)
 	{
@@ -950,7 +937,7 @@ double ShProjection::pcc(const ThetaPhi& tp, const ShProjection::UseHarms* pUseH
 			//	m_mBands * m_mBands + (l - m_mBands) * (2 * m_mBands - 1) + (m + m_mBands - 1);
 			int nIndex1 = getIndex(l, m);
 
-			double dY = m_sph.Y(l, m, tp.theta, tp.phi);
+			double dY = ys[nIndex1];
 			double dC = m_coefs[nIndex1]; // l*(l + 1) + m];
 			dBand += dC * dY;
 		}
@@ -981,6 +968,8 @@ return evaluate(theta, fi);
 double ShProjection::evaluateWo0(const ThetaPhi& tp) const
 {
 	double result = 0.0;
+	std::vector<double> ys;
+	m_sph.getY(m_nBands, m_mBands, tp.theta, tp.phi, ys);
 
 	for (int l = 0; l < m_nBands; l++)
 	{
@@ -997,7 +986,7 @@ double ShProjection::evaluateWo0(const ThetaPhi& tp) const
 			//	m_mBands * m_mBands + (l - m_mBands) * (2 * m_mBands - 1) + (m + m_mBands - 1);
 			int nIndex1 = getIndex(l, m);
 
-			double dY = m_sph.Y(l, m, tp.theta, tp.phi);
+			double dY = ys[nIndex1];
 			double dC = m_coefs[nIndex1]; // l*(l + 1) + m];
 			dBand += dC * dY;
 		}
@@ -1011,6 +1000,8 @@ double ShProjection::evaluateWo0(const ThetaPhi& tp) const
 double ShProjection::evaluate(double theta) const
 {
 	double result = 0.0;
+	std::vector<double> ys;
+	m_sph.getY(m_nBands, 1, theta, 0, ys);
 
 	for (int l = 0; l < m_nBands; l++)
 	{
@@ -1022,7 +1013,7 @@ double ShProjection::evaluate(double theta) const
 			//	m_mBands * m_mBands + (l - m_mBands) * (2 * m_mBands - 1) + (m + m_mBands - 1);
 			int nIndex1 = getIndex(l, m);
 
-			double dY = m_sph.Y(l, m, theta, 0);
+			double dY = ys[l];
 			double dC = m_coefs[nIndex1]; // l*(l + 1) + m];
 			dBand += dC * dY;
 		}
@@ -1036,6 +1027,8 @@ double ShProjection::evaluate(double theta) const
 double ShProjection::evaluate(const ThetaPhi& tp) const
 {
 	double result = 0.0;
+	std::vector<double> ys;
+	m_sph.getY(m_nBands, m_mBands, tp.theta, tp.phi, ys);
 
 	for (int l = 0; l < m_nBands; l++)
 	{
@@ -1046,7 +1039,7 @@ double ShProjection::evaluate(const ThetaPhi& tp) const
 			//	m_mBands * m_mBands + (l - m_mBands) * (2 * m_mBands - 1) + (m + m_mBands - 1);
 			int nIndex1 = getIndex(l, m);
 
-			double dY = m_sph.Y(l, m, tp.theta, tp.phi);
+			double dY = ys[nIndex1];
 			double dC = m_coefs[nIndex1]; // l*(l + 1) + m];
 			dBand += dC * dY;
 		}
@@ -1063,6 +1056,8 @@ double ShProjection::evaluatePcvOnly(double theta, Point3d* pptCnt) const
 
 	if (pptCnt == NULL)
 	{
+		std::vector<double> ys;
+		m_sph.getY(m_nBands, 1, theta, 0, ys);
 
 		for (int l = 2; l < m_nBands; l++)
 		{
@@ -1074,7 +1069,7 @@ double ShProjection::evaluatePcvOnly(double theta, Point3d* pptCnt) const
 				//	m_mBands * m_mBands + (l - m_mBands) * (2 * m_mBands - 1) + (m + m_mBands - 1);
 				int nIndex1 = getIndex(l, m);
 
-				double dY = m_sph.Y(l, m, theta, 0);
+				double dY = ys[l];
 				double dC = m_coefs[nIndex1]; // l*(l + 1) + m];
 				dBand += dC * dY;
 			}
@@ -1325,6 +1320,8 @@ void ShFreqProjection::appendEqs(const ZenAz& za, double f, double dPh, double w
 	//double theta = (90 - ele) * PI / 180;
 	//double fi = (90-az) * PI / 180;
 	ThetaPhi tp(za);
+	std::vector<double> ys;
+	m_sph.getY(nBands, mBands, tp.theta, tp.phi, ys);
 
 	for (int k0 = 0; k0 < (int)m_shps.size(); k0++)
 	{
@@ -1338,7 +1335,7 @@ void ShFreqProjection::appendEqs(const ZenAz& za, double f, double dPh, double w
 				if (k0 > 0)
 					nIndex0 += N.rows() / 2;
 
-				double coef0 = m_sph.Y(l0, m0, tp.theta, tp.phi) * pow(f, k0);
+				double coef0 = ys[ShProjection::getIndex(nBands, mBands, l0, m0)] * pow(f, k0);
 				U[nIndex0] += weight * dPh * coef0;
 				for (int k1 = 0; k1 < (int)m_shps.size(); k1++)
 				{
@@ -1355,7 +1352,7 @@ void ShFreqProjection::appendEqs(const ZenAz& za, double f, double dPh, double w
 							if (nIndex1 > nIndex0)
 								continue;
 
-							double coef1 = m_sph.Y(l1, m1, tp.theta, tp.phi) * pow(f, k1);
+							double coef1 = ys[ShProjection::getIndex(nBands, mBands, l1, m1)] * pow(f, k1);
 
 							N(nIndex1, nIndex0) += weight * coef0 * coef1;
 							//N(nIndex1, nIndex2) = N(nIndex2, nIndex1);
@@ -1374,6 +1371,8 @@ void ShFreqProjection::appendEqsSemi(const ZenAz& za, double f, double dPh, doub
 	//double theta = (90 - ele) * PI / 180;
 	//double fi = (90-az) * PI / 180;
 	ThetaPhi tp(za);
+	std::vector<double> ys;
+	m_sph.getY(nBands, mBands, tp.theta, tp.phi, ys);
 
 	for (int k0 = 0; k0 < (int)m_shps.size(); k0++)
 	{
@@ -1390,7 +1389,7 @@ void ShFreqProjection::appendEqsSemi(const ZenAz& za, double f, double dPh, doub
 				if (k0 > 0)
 					nIndex0 += m_shps[0].getSemiSize()*k0; // N.rows() / 2;
 
-				double coef0 = m_sph.Y(l0, m0, tp.theta, tp.phi) * pow(f, k0);
+				double coef0 = ys[ShProjection::getIndex(nBands, mBands, l0, m0)] * pow(f, k0);
 				U[nIndex0] += weight * dPh * coef0;
 				for (int k1 = 0; k1 < (int)m_shps.size(); k1++)
 				{
@@ -1410,7 +1409,7 @@ void ShFreqProjection::appendEqsSemi(const ZenAz& za, double f, double dPh, doub
 							if (nIndex1 > nIndex0)
 								continue;
 
-							double coef1 = m_sph.Y(l1, m1, tp.theta, tp.phi) * pow(f, k1);
+							double coef1 = ys[ShProjection::getIndex(nBands, mBands, l1, m1)] * pow(f, k1);
 
 							N(nIndex1, nIndex0) += weight * coef0 * coef1;
 							//N(nIndex1, nIndex2) = N(nIndex2, nIndex1);
@@ -1541,6 +1540,8 @@ ShFreqProjection2::ShFreqProjection2()
 	m_mBands = 0;
 	m_K = 0;
 	m_Q = 0;
+	m_dLogDet = NAN;
+	m_dCondition = NAN;
 }
 
 ShFreqProjection2::~ShFreqProjection2()
@@ -1573,6 +1574,8 @@ void ShFreqProjection2::setBands(int nBands, int mBands, int K, int Q, double dE
 	m_0s.SetSize(Q);
 	for (int i = 0; i < Q; i++)
 		m_0s[i] = 0.0;
+	m_dLogDet = NAN;
+	m_dCondition = NAN;
 }
 
 void ShFreqProjection2::setBands(int nBands, int mBands, int K, int Q, const SphericalHarmonics& sph)
@@ -1592,6 +1595,8 @@ void ShFreqProjection2::setBands(int nBands, int mBands, int K, int Q, const Sph
 	m_0s.SetSize(Q);
 	for (int i = 0; i < Q; i++)
 		m_0s[i] = 0.0;
+	m_dLogDet = NAN;
+	m_dCondition = NAN;
 }
 
 void ShFreqProjection2::setPhaseCenter(const Point3d& pco, const double* pfs, const double* pfNorms, int nfs, int nTetas, int nPhis)
@@ -1639,75 +1644,27 @@ ShFreqProjection2& ShFreqProjection2::operator=(const ShFreqProjection2& a)
 	}
 
 	m_sph = a.m_sph;
+	m_dLogDet = a.m_dLogDet;
+	m_dCondition = a.m_dCondition;
 
 	return *this;
 }
 
 void ShFreqProjection2::appendEqs(const ZenAz& ea, double f, double dPh, double weight, Matrix& N, Vector& U)
 {
-	int nBands = m_shps[0].m_nBands;
-	int mBands = m_shps[0].m_mBands;
-	ThetaPhi tp(ea);
-
-	HarmIndex hi0 = getFirstHarmIndex();
-
-	do
-	{
-		int nIndex0 = getIndex(hi0); // q0, k0, l0, m0);
-
-		double y0 = getMoment(f, tp, hi0); // q0, k0, l0, m0);
-
-		N(nIndex0, nIndex0) += y0 * y0 * weight;
-		U[nIndex0] += weight * dPh * y0;
-
-
-		HarmIndex hi1 = hi0;
-		while (getNextIndex(hi1)) //q1, k1, l1, m1))
-		{
-			int nIndex1 = getIndex(hi1); // q1, k1, l1, m1);
-			double y1 = getMoment(f, tp, hi1); // q1, k1, l1, m1);
-
-			N(nIndex0, nIndex1) += y0 * y1 * weight;
-		}
-
-	} while (getNextIndex(hi0)); // q0, k0, l0, m0));
+	thread_local std::vector<double> moments;
+	getMoments(f, ThetaPhi(ea), moments);
 
+	// Upper triangle of N only
+	N.syr(weight, moments.data(), (int)moments.size());
+	U.axpy(weight * dPh, moments.data(), (int)moments.size());
 }
 
 void ShFreqProjection2::appendEqs(const ZenAz& ea, double f, double weight, Matrix& N)
 {
-	//ASSERT(m_shps.GetSize() > 0);
-	//int nBands = m_shps[0].m_nBands;
-	//int mBands = m_shps[0].m_mBands;
-	//double theta = (90 - ele) * PI / 180;
-	//double fi = (90 - az) * PI / 180;
-	ThetaPhi tp(ea);
-
-	int q0 = 0;
-	int k0 = 0;
-	int l0 = 0;
-	int m0 = 0;
-	do
-	{
-		int nIndex0 = getIndex(q0, k0, l0, m0);
-
-		double y0 = getMoment(f, tp, q0, k0, l0, m0);
-
-		N(nIndex0, nIndex0) += y0 * y0 * weight;
-
-		int q1 = q0;
-		int k1 = k0;
-		int l1 = l0;
-		int m1 = m0;
-		while (getNextIndex(q1, k1, l1, m1))
-		{
-			int nIndex1 = getIndex(q1, k1, l1, m1);
-			double y1 = getMoment(f, tp, q1, k1, l1, m1);
-
-			N(nIndex0, nIndex1) += y0 * y1 * weight;
-		}
-
-	} while (getNextIndex(q0, k0, l0, m0));
+	thread_local std::vector<double> moments;
+	getMoments(f, ThetaPhi(ea), moments);
+	N.syr(weight, moments.data(), (int)moments.size());
 }
 
 int ShFreqProjection2::getIndex(const HarmIndex& hi) const
@@ -1841,6 +1798,29 @@ double ShFreqProjection2::getMoment(double f, const ThetaPhi& tp, int q, int k,
 	return d;
 }
 
+void ShFreqProjection2::getMoments(double f, const ThetaPhi& tp, std::vector<double>& moments) const
+{
+	moments.resize(getMatrixSize());
+	for (int q = 0; q < m_Q; q++)
+	{
+		moments[q] = pow(f, q);
+	}
+
+	// Harmonics but Y(0, 0) for each power of f
+	thread_local std::vector<double> ys;
+	m_sph.getY(m_nBands, m_mBands, tp.theta, tp.phi, ys);
+	int nHarmCoefs = (int)ys.size() - 1;
+	double* pMoments = moments.data() + m_Q;
+	for (int k = 0; k < m_K; k++, pMoments += nHarmCoefs)
+	{
+		double p = pow(f, k);
+		for (int i = 0; i < nHarmCoefs; i++)
+		{
+			pMoments[i] = ys[i + 1] * p;
+		}
+	}
+}
+
 void ShFreqProjection2::getCoefs(Vector& X) const
 {
 	X.resize(getMatrixSize());
@@ -2056,28 +2036,34 @@ bool ShFreqProjection2::project(ShFreqFunction& shf, int nBands, int mBands, Mat
 	Vector Y(nMatrixSize);
 	A.init(0);
 	Y.init(0);
-	for (int nObs = 0; nObs < shf.getMeasCount(); nObs++)
-	{
-		ThetaPhi tp;
-		double f;
-		double meas = shf.getMeas(nObs, f, tp);
-		for (int nRow = 0; nRow < nMatrixSize; nRow++)
-		{
-			HarmIndex row = getHarmIndex(nRow);
-			double rowMoment = getMoment(f, tp, row);
-			Y[nRow] += meas * rowMoment;
-			for (int nCol = 0; nCol < nMatrixSize; nCol++)
-			{
-				HarmIndex col = getHarmIndex(nCol);
-				double colMoment = getMoment(f, tp, col);
 
-				A(nRow, nCol) += rowMoment * colMoment;
-			}
-		}
+	// The measurements are read in order, the moments are evaluated and summed in
+	// parallel (NormalEqs)
+	int nMeas = shf.getMeasCount();
+	std::vector<ThetaPhi> tps(nMeas);
+	std::vector<double> fs(nMeas), meas(nMeas);
+	for (int nObs = 0; nObs < nMeas; nObs++)
+	{
+		meas[nObs] = shf.getMeas(nObs, fs[nObs], tps[nObs]);
 	}
 
+	NormalEqs& eqs = NormalEqs::getLocal();
+	eqs.accumulate(nMatrixSize, nMeas, [&](int nObs, double* row, double& value, double& weight) {
+		thread_local std::vector<double> moments;
+		getMoments(fs[nObs], tps[nObs], moments);
+		std::copy(moments.begin(), moments.end(), row);
+		value = meas[nObs];
+		weight = 1;
+		return true;
+	}, A, Y);
+	A.copyUpperTriangle();
+
 	Vector X(nMatrixSize);
-	X = A.solve(Y);
+	Cholesky chol;
+	bool bSpd = chol.factor(A);
+	X = bSpd ? chol.solve(Y) : A.solve(Y);
+	m_dLogDet = bSpd ? chol.getLogDet() : NAN;
+	m_dCondition = bSpd ? chol.getCondition() : INFINITY;
 
 	if (pN != nullptr)
 	{
@@ -2085,8 +2071,15 @@ bool ShFreqProjection2::project(ShFreqFunction& shf, int nBands, int mBands, Mat
 	}
 	if (pC != nullptr)
 	{
-		*pC = A;
-		pC->inverse();
+		if (bSpd)
+		{
+			chol.inverse(*pC);
+		}
+		else
+		{
+			*pC = A;
+			pC->inverse();
+		}
 	}
 
 	setCoefs(X);
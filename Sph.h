@@ -64,6 +64,9 @@ namespace nzg
 		double K(int l, int m) const;
 		double Y(int l, int m, double theta, double phi) const;
 
+		// All Y(l, m, theta, phi) for l < nBands and |m| < mBands in one pass: by l, then by m
+		// from -min(l, mBands - 1) up, the order of ShProjection coefficients
+		void getY(int nBands, int mBands, double theta, double phi, std::vector<double>& ys) const;
 
 		// Returns derivatives dP(cos(theta))/dtheta for given theta [radians]
 		// given m and for different |l| <= lMax. 
@@ -190,10 +193,16 @@ namespace nzg
 		std::vector <double> m_coefs;
 		Matrix m_q; // Cofactor matrix (Invert(N))
 		double m_sigma; // Estimated variance of unit weight
+		// Normal matrix of the last project(): ln det N and a lower bound of its condition
+		// number (Cholesky); NaN and infinity if N is not positive definite, NaN before a fit
+		double m_dLogDet;
+		double m_dCondition;
 		SphericalHarmonics m_sph;
 		void setBands(int nBands, int mBands, double dEleMaskDeg);
 		void setBands(int nBands, int mBands, const SphericalHarmonics& sph);
 		bool canEvaluate() const;
+		double getLogDet() const { return m_dLogDet; }
+		double getCondition() const { return m_dCondition; }
 
 		// Get the position of coeficient (l, m) in m_dCoefs
 		int getIndex(int l, int m) const {
@@ -257,6 +266,7 @@ namespace nzg
 		void mix(const ShProjection& a, double alfa); // this = (1-alfa)*this + alfa*a
 		void project(ShFunction& shf, int nBands, int mBands);
 		ShProjection project(int nBands, int mBands, const SphericalHarmonics& sph, double eleMask) const; // rebuild this projection into (nBands, mBands)
+		// The appendEqs fill the upper triangle of N only, N.copyUpperTriangle() after the last one
 		void appendEqs(double ele, double az, double dRotAngle, double dPh, double weight, Matrix& N, Vector& U) const;
 		void appendEqs(double ele, double az, double dPh, double weight, Matrix& N, Vector& U) const;
 		void appendEqs2(double ele, double az, double dPh, double weight, Matrix& N, Vector& U);
@@ -407,8 +417,13 @@ namespace nzg
 		SphericalHarmonics m_sph;
 		std::vector <ShProjection> m_shps;
 		CArray <double, double> m_0s;
+		// Normal matrix of the last project(), as in ShProjection
+		double m_dLogDet;
+		double m_dCondition;
 		void setBands(int nBands, int mBands, int K, int Q, double dEleMaskDeg);
 		void setBands(int nBands, int mBands, int K, int Q, const SphericalHarmonics& sph);
+		double getLogDet() const { return m_dLogDet; }
+		double getCondition() const { return m_dCondition; }
 
 		// ptPco is in meters, pfs - frequencies for which to evaluate, nfs - number of freqs
 		void setPhaseCenter(const Point3d& ptPco, const double* pfs, const double* pfNorms, int nfs, int nTetas, int nPhis);
@@ -432,6 +447,8 @@ namespace nzg
 		// Get Y(l, m, theta, fi) * pow(f, k)
 		double getMoment(double f, const ThetaPhi& tp, const HarmIndex& hi) const;
 		double getMoment(double f, const ThetaPhi& tp, int q, int k, int l, int m) const;
+		// All the moments of an observation in one pass, in the order of the unknowns
+		void getMoments(double f, const ThetaPhi& tp, std::vector<double>& moments) const;
 
 		void getCoefs(Vector& X) const;
 		void setCoefs(Vector& X);
@@ -0,0 +1,90 @@
+#pragma once
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////
+	// SpscQueue - bounded lock-free ring between one producer thread and one consumer
+	// thread. Each side keeps its own index on its own cache line plus a cached copy of
+	// the other one, so a push or a pop touches the shared line only when the ring
+	// looks full or empty. The consumer can block on an empty ring without a lock.
+	template<class T>
+	class SpscQueue
+	{
+	// Construction:
+	public:
+		explicit SpscQueue(size_t capacity = 0) {
+			reset(capacity);
+		}
+		SpscQueue(const SpscQueue&) = delete;
+		SpscQueue& operator=(const SpscQueue&) = delete;
+
+		// Empty ring of at least capacity slots; neither side may be using it
+		void reset(size_t capacity) {
+			size_t n = 1;
+			while (n < capacity)
+				n <<= 1;
+			m_buf.assign(n, T());
+			m_mask = n - 1;
+			m_head.store(0, std::memory_order_relaxed);
+			m_tail.store(0, std::memory_order_relaxed);
+			m_headCache = 0;
+			m_tailCache = 0;
+		}
+
+	// Attributes:
+	public:
+		size_t getCapacity() const { return m_buf.size(); }
+
+	// Operations:
+	public:
+		// Producer: false if the ring is full
+		bool push(const T& value) {
+			size_t tail = m_tail.load(std::memory_order_relaxed);
+			if (tail - m_headCache == m_buf.size())
+			{
+				m_headCache = m_head.load(std::memory_order_acquire);
+				if (tail - m_headCache == m_buf.size())
+					return false;
+			}
+			m_buf[tail & m_mask] = value;
+			m_tail.store(tail + 1, std::memory_order_release);
+			m_tail.notify_one();
+			return true;
+		}
+
+		// Consumer: false if the ring is empty
+		bool pop(T& value) {
+			size_t head = m_head.load(std::memory_order_relaxed);
+			if (head == m_tailCache)
+			{
+				m_tailCache = m_tail.load(std::memory_order_acquire);
+				if (head == m_tailCache)
+					return false;
+			}
+			value = m_buf[head & m_mask];
+			m_head.store(head + 1, std::memory_order_release);
+			return true;
+		}
+
+		// Consumer: sleeps until there is something to pop
+		void waitPop(T& value) {
+			while (!pop(value))
+				m_tail.wait(m_head.load(std::memory_order_relaxed), std::memory_order_acquire);
+		}
+
+	// Implementation:
+	protected:
+		std::vector<T> m_buf;
+		size_t m_mask;
+
+		// Consumer side
+		alignas(64) std::atomic<size_t> m_head;
+		size_t m_tailCache;
+
+		// Producer side
+		alignas(64) std::atomic<size_t> m_tail;
+		size_t m_headCache;
+	};
+	// End of SpscQueue
+	////////////////////////////////////////////////////////////////////////////////
+}
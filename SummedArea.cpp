@@ -0,0 +1,306 @@
+#include "pch.h"
+
+#include "SummedArea.h"
+
+namespace nzg
+{
+	namespace
+	{
+		const char c_magic[4] = { 'N', 'Z', 'G', 'S' };
+		const uint32_t c_version = 1;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	// SummedArea implementation
+	SummedArea::SummedArea() : maxTables(16), threads(0), m_rows(0), m_cols(0), m_nStep(1), m_nRowLines(0),
+		m_nColLines(0), m_nGeneration(0)
+	{
+	}
+
+	template<class T>
+	T SummedArea::sum(const std::vector<T>& table, int row0, int col0, int row1, int col1) const
+	{
+		if (table.empty())
+			return 0;
+		int r0 = getLine(row0, m_rows, m_nRowLines);
+		int r1 = getLine(row1, m_rows, m_nRowLines);
+		int c0 = getLine(col0, m_cols, m_nColLines);
+		int c1 = getLine(col1, m_cols, m_nColLines);
+		if (r0 >= r1 || c0 >= c1)
+			return 0;
+		const T* p0 = table.data() + (size_t)r0 * m_nColLines;
+		const T* p1 = table.data() + (size_t)r1 * m_nColLines;
+		// Unsigned counts wrap consistently, the difference is right
+		return p1[c1] - p1[c0] - p0[c1] + p0[c0];
+	}
+
+	int64_t SummedArea::getCount(TypeId type, int row0, int col0, int row1, int col1) const
+	{
+		for (size_t k = 0; k < m_types.size(); k++)
+		{
+			if (m_types[k] == type)
+				return sum(m_counts[k], row0, col0, row1, col1);
+		}
+		return 0;
+	}
+
+	int64_t SummedArea::getScoreSum(int row0, int col0, int row1, int col1) const
+	{
+		return sum(m_scores, row0, col0, row1, col1);
+	}
+
+	int64_t SummedArea::getCells(int row0, int col0, int row1, int col1) const
+	{
+		if (m_nRowLines == 0)
+			return 0;
+		int r0 = std::min(getLine(row0, m_rows, m_nRowLines) * m_nStep, m_rows);
+		int r1 = std::min(getLine(row1, m_rows, m_nRowLines) * m_nStep, m_rows);
+		int c0 = std::min(getLine(col0, m_cols, m_nColLines) * m_nStep, m_cols);
+		int c1 = std::min(getLine(col1, m_cols, m_nColLines) * m_nStep, m_cols);
+		return r0 < r1 && c0 < c1 ? (int64_t)(r1 - r0) * (c1 - c0) : 0;
+	}
+
+	double SummedArea::getFraction(TypeId type, int row0, int col0, int row1, int col1) const
+	{
+		int64_t nCells = getCells(row0, col0, row1, col1);
+		return nCells > 0 ? getCount(type, row0, col0, row1, col1) / (double)nCells : 0;
+	}
+
+	double SummedArea::getMeanScore(int row0, int col0, int row1, int col1) const
+	{
+		int64_t nCells = getCells(row0, col0, row1, col1);
+		return nCells > 0 ? getScoreSum(row0, col0, row1, col1) / (double)nCells : 0;
+	}
+
+	void SummedArea::build(const GenView& view, int step)
+	{
+		m_pool.setThreads(threads);
+		build(view, step, m_pool);
+	}
+
+	// At full resolution each table is one pass down the rows, a line being the one above
+	// plus the running sum along the row, with the tables in parallel. Coarser tables sum
+	// bands of step rows into their line in parallel, prefix summed along the line, then
+	// prefix sum the lines down the columns, in parallel by chunks of columns
+	void SummedArea::build(const GenView& view, int step, ThreadPool& pool)
+	{
+		NZG_PROF_SCOPE("SummedArea::build");
+		m_rows = std::max(view.rows, 0);
+		m_cols = std::max(view.cols, 0);
+		m_nStep = std::max(step, 1);
+		m_nRowLines = (m_rows + m_nStep - 1) / m_nStep + 1;
+		m_nColLines = (m_cols + m_nStep - 1) / m_nStep + 1;
+		m_nGeneration = view.generation;
+		chooseTypes(view);
+
+		int nTables = (int)m_types.size();
+		size_t nSize = (size_t)m_nRowLines * m_nColLines;
+		m_counts.resize(nTables);
+		for (auto& counts : m_counts)
+			counts.resize(nSize);
+		m_scores.resize(nSize);
+		for (auto& counts : m_counts)
+			std::fill(counts.begin(), counts.begin() + m_nColLines, 0);
+		std::fill(m_scores.begin(), m_scores.begin() + m_nColLines, 0);
+
+		if (m_nStep == 1)
+		{
+			pool.run(nTables + 1, [&](int k, int) {
+				for (int i = 0; i < m_rows; i++)
+				{
+					size_t nLine = (size_t)(i + 1) * m_nColLines;
+					const TypeId* pTypes = view.types + (size_t)i * m_cols;
+					if (k < nTables)
+					{
+						TypeId type = m_types[k];
+						const uint32_t* pUp = m_counts[k].data() + nLine - m_nColLines;
+						uint32_t* pLine = m_counts[k].data() + nLine;
+						uint32_t run = 0;
+						pLine[0] = 0;
+						for (int j = 0; j < m_cols; j++)
+							pLine[j + 1] = pUp[j + 1] + (run += pTypes[j] == type);
+					}
+					else
+					{
+						const int* pScores = view.scores + (size_t)i * m_cols;
+						const int64_t* pUp = m_scores.data() + nLine - m_nColLines;
+						int64_t* pLine = m_scores.data() + nLine;
+						int64_t run = 0;
+						pLine[0] = 0;
+						for (int j = 0; j < m_cols; j++)
+							pLine[j + 1] = pUp[j + 1] + (run += pScores[j]);
+					}
+				}
+			});
+			return;
+		}
+
+		// Types without a table count into slot nTables, which is dropped
+		std::vector<int> slots(view.strats->getCount(), nTables);
+		for (int k = 0; k < nTables; k++)
+			slots[m_types[k]] = k;
+
+		int nCols = m_nColLines - 1;
+		std::vector<std::vector<uint32_t>> bandCounts(pool.getThreads());
+		std::vector<std::vector<int64_t>> bandScores(pool.getThreads());
+		pool.parallelFor(m_nRowLines - 1, [&](int band0, int band1, int thread) {
+			std::vector<uint32_t>& counts = bandCounts[thread];
+			std::vector<int64_t>& scores = bandScores[thread];
+			for (int b = band0; b < band1; b++)
+			{
+				counts.assign((size_t)(nTables + 1) * nCols, 0);
+				scores.assign(nCols, 0);
+				for (int i = b * m_nStep; i < std::min((b + 1) * m_nStep, m_rows); i++)
+				{
+					const TypeId* pTypes = view.types + (size_t)i * m_cols;
+					const int* pScores = view.scores + (size_t)i * m_cols;
+					for (int c = 0; c < nCols; c++)
+					{
+						int64_t sum = 0;
+						for (int j = c * m_nStep; j < std::min((c + 1) * m_nStep, m_cols); j++)
+						{
+							counts[(size_t)slots[pTypes[j]] * nCols + c]++;
+							sum += pScores[j];
+						}
+						scores[c] += sum;
+					}
+				}
+
+				size_t nLine = (size_t)(b + 1) * m_nColLines;
+				for (int k = 0; k < nTables; k++)
+				{
+					uint32_t run = 0;
+					uint32_t* pLine = m_counts[k].data() + nLine;
+					pLine[0] = 0;
+					for (int c = 0; c < nCols; c++)
+						pLine[c + 1] = run += counts[(size_t)k * nCols + c];
+				}
+				int64_t run = 0;
+				m_scores[nLine] = 0;
+				for (int c = 0; c < nCols; c++)
+					m_scores[nLine + c + 1] = run += scores[c];
+			}
+		});
+
+		const int nChunk = 1024;
+		int nChunks = (m_nColLines + nChunk - 1) / nChunk;
+		pool.run((nTables + 1) * nChunks, [&](int task, int) {
+			int k = task / nChunks;
+			int c0 = task % nChunks * nChunk;
+			int c1 = std::min(c0 + nChunk, m_nColLines);
+			for (int r = 1; r < m_nRowLines; r++)
+			{
+				size_t nUp = (size_t)(r - 1) * m_nColLines;
+				size_t nLine = (size_t)r * m_nColLines;
+				if (k < nTables)
+				{
+					uint32_t* p = m_counts[k].data();
+					for (int c = c0; c < c1; c++)
+						p[nLine + c] += p[nUp + c];
+				}
+				else
+				{
+					for (int c = c0; c < c1; c++)
+						m_scores[nLine + c] += m_scores[nUp + c];
+				}
+			}
+		});
+	}
+
+	void SummedArea::chooseTypes(const GenView& view)
+	{
+		m_types.clear();
+		for (TypeId t : types)
+		{
+			if (t < view.strats->getCount() && std::find(m_types.begin(), m_types.end(), t) == m_types.end())
+				m_types.push_back(t);
+		}
+		if (!types.empty())
+			return;
+
+		std::vector<int64_t> counts(view.strats->getCount(), 0);
+		int64_t nCells = (int64_t)m_rows * m_cols;
+		for (int64_t i = 0; i < nCells; i++)
+			counts[view.types[i]]++;
+		for (size_t t = 0; t < counts.size(); t++)
+		{
+			if (counts[t] > 0)
+				m_types.push_back((TypeId)t);
+		}
+		std::stable_sort(m_types.begin(), m_types.end(), [&](TypeId a, TypeId b) { return counts[a] > counts[b]; });
+		if ((int)m_types.size() > maxTables)
+			m_types.resize(std::max(maxTables, 0));
+		std::sort(m_types.begin(), m_types.end());
+	}
+
+	// Header of magic, version, rows, cols, step, generation and the type ids, then the
+	// count tables and the score table, row major by lines
+	bool SummedArea::save(const std::string& path) const
+	{
+		NZG_PROF_SCOPE("SummedArea::save");
+		std::ofstream f(std::filesystem::path(path), std::ios::binary | std::ios::trunc);
+		if (!f)
+			return false;
+
+		uint32_t head[4] = { c_version, (uint32_t)m_rows, (uint32_t)m_cols, (uint32_t)m_nStep };
+		uint32_t nTypes = (uint32_t)m_types.size();
+		f.write(c_magic, sizeof(c_magic));
+		f.write((const char*)head, sizeof(head));
+		f.write((const char*)&m_nGeneration, sizeof(m_nGeneration));
+		f.write((const char*)&nTypes, sizeof(nTypes));
+		f.write((const char*)m_types.data(), m_types.size() * sizeof(TypeId));
+		for (const auto& counts : m_counts)
+			f.write((const char*)counts.data(), counts.size() * sizeof(uint32_t));
+		f.write((const char*)m_scores.data(), m_scores.size() * sizeof(int64_t));
+		return (bool)f;
+	}
+
+	bool SummedArea::load(const std::string& path)
+	{
+		std::ifstream f(std::filesystem::path(path), std::ios::binary);
+		char magic[4];
+		uint32_t head[4];
+		int64_t generation;
+		uint32_t nTypes;
+		if (!f.read(magic, sizeof(magic)) || memcmp(magic, c_magic, sizeof(magic)) != 0 ||
+			!f.read((char*)head, sizeof(head)) || head[0] != c_version || head[3] == 0 ||
+			head[1] > INT_MAX || head[2] > INT_MAX ||
+			!f.read((char*)&generation, sizeof(generation)) || !f.read((char*)&nTypes, sizeof(nTypes)) ||
+			nTypes > StratTable::none)
+			return false;
+
+		std::vector<TypeId> typesRead(nTypes);
+		if (!f.read((char*)typesRead.data(), nTypes * sizeof(TypeId)))
+			return false;
+
+		int rows = (int)head[1];
+		int cols = (int)head[2];
+		int step = (int)head[3];
+		int nRowLines = (rows + step - 1) / step + 1;
+		int nColLines = (cols + step - 1) / step + 1;
+		size_t nSize = (size_t)nRowLines * nColLines;
+		std::vector<std::vector<uint32_t>> counts(nTypes);
+		for (auto& c : counts)
+		{
+			c.resize(nSize);
+			if (!f.read((char*)c.data(), nSize * sizeof(uint32_t)))
+				return false;
+		}
+		std::vector<int64_t> scores(nSize);
+		if (!f.read((char*)scores.data(), nSize * sizeof(int64_t)))
+			return false;
+
+		m_rows = rows;
+		m_cols = cols;
+		m_nStep = step;
+		m_nRowLines = nRowLines;
+		m_nColLines = nColLines;
+		m_nGeneration = generation;
+		m_types.swap(typesRead);
+		m_counts.swap(counts);
+		m_scores.swap(scores);
+		return true;
+	}
+	// End of SummedArea implementation
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+}
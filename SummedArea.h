@@ -0,0 +1,67 @@
+#pragma once
+
+#include "NzgNode.h"
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////
+	// SummedArea - summed-area tables of the map: T(r, c) holds the cells of a type
+	// (or the total score) in [0, r) x [0, c), so any rectangle costs four lookups.
+	// The tables may be built on grid lines every step cells only, for a fraction of
+	// the memory; rectangles then snap to these lines. Saved tables go with recorded
+	// frames (FrameWriter::tables), for region queries over the history of a run.
+	class SummedArea
+	{
+	// Construction:
+	public:
+		SummedArea();
+
+	// Attributes:
+	public:
+		std::vector<TypeId> types;	// Types with a table, empty for the maxTables commonest ones of the map
+		int maxTables;
+		int threads;				// 0 for all hardware threads
+
+		int64_t getGeneration() const { return m_nGeneration; }
+		int getRows() const { return m_rows; }
+		int getCols() const { return m_cols; }
+		int getStep() const { return m_nStep; }
+		const std::vector<TypeId>& getTypes() const { return m_types; } // Of the tables built or loaded
+
+		// Rectangle [row0, row1) x [col0, col1), clipped to the map and snapped down to the lines
+		int64_t getCount(TypeId type, int row0, int col0, int row1, int col1) const; // 0 for types without a table
+		int64_t getScoreSum(int row0, int col0, int row1, int col1) const;
+		int64_t getCells(int row0, int col0, int row1, int col1) const;
+		double getFraction(TypeId type, int row0, int col0, int row1, int col1) const;
+		double getMeanScore(int row0, int col0, int row1, int col1) const;
+
+	// Operations:
+	public:
+		void build(const GenView& view, int step = 1);
+		void build(const GenView& view, int step, ThreadPool& pool);
+		bool save(const std::string& path) const;
+		bool load(const std::string& path);
+
+	// Implementation:
+	protected:
+		int m_rows;
+		int m_cols;
+		int m_nStep;
+		int m_nRowLines;	// ceil(rows / step) + 1, the last one at rows
+		int m_nColLines;
+		int64_t m_nGeneration;
+		std::vector<TypeId> m_types;
+		std::vector<std::vector<uint32_t>> m_counts; // Per type, m_nRowLines x m_nColLines
+		std::vector<int64_t> m_scores;
+		ThreadPool m_pool;
+
+		int getLine(int x, int size, int nLines) const {
+			return x >= size ? nLines - 1 : std::max(x, 0) / m_nStep;
+		}
+		template<class T>
+		T sum(const std::vector<T>& table, int row0, int col0, int row1, int col1) const;
+		void chooseTypes(const GenView& view);
+	};
+	// End of SummedArea
+	////////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,149 @@
+#include "pch.h"
+
+#include "ThreadPool.h"
+#include "Numa.h"
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	// ThreadPool implementation
+	ThreadPool::ThreadPool() : m_fn(nullptr), m_nTasks(0), m_nextTask(0), m_nBusy(0), m_nRun(0), m_bStop(false), m_bAffinity(false)
+	{
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		stop();
+	}
+
+	int ThreadPool::getHardwareThreads()
+	{
+		return std::max(1, (int)std::thread::hardware_concurrency());
+	}
+
+	void ThreadPool::setThreads(int nThreads)
+	{
+		if (nThreads <= 0)
+			nThreads = getHardwareThreads();
+		if (nThreads == getThreads())
+			return;
+
+		stop();
+		m_bStop = false;
+		for (int i = 1; i < nThreads; i++)
+			m_threads.push_back(std::thread(&ThreadPool::worker, this, i, nThreads, m_nRun));
+	}
+
+	// The workers pin themselves when they start, so a change restarts them
+	void ThreadPool::setAffinity(bool bAffinity)
+	{
+		if (bAffinity == m_bAffinity)
+			return;
+
+		int nThreads = getThreads();
+		stop();
+		m_bAffinity = bAffinity;
+		setThreads(nThreads);
+	}
+
+	void ThreadPool::stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_bStop = true;
+		}
+		m_cvStart.notify_all();
+		for (auto& t : m_threads)
+			t.join();
+		m_threads.clear();
+	}
+
+	void ThreadPool::run(int nTasks, const std::function<void(int, int)>& fn)
+	{
+		if (m_threads.empty() || nTasks <= 1)
+		{
+			for (int i = 0; i < nTasks; i++)
+				fn(i, 0);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_fn = &fn;
+			m_nTasks = nTasks;
+			m_nextTask = 0;
+			m_nBusy = (int)m_threads.size();
+			m_nRun++;
+		}
+		m_cvStart.notify_all();
+
+		work(0);
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cvDone.wait(lock, [this] { return m_nBusy == 0; });
+		m_fn = nullptr;
+	}
+
+	void ThreadPool::parallelFor(int n, const std::function<void(int, int, int)>& fn)
+	{
+		if (n <= 0)
+			return;
+
+		// A few chunks per thread even out rows of unequal cost
+		int nChunks = std::min(n, getThreads() * 4);
+		run(nChunks, [&](int task, int thread) {
+			int begin = (int)((int64_t)n * task / nChunks);
+			int end = (int)((int64_t)n * (task + 1) / nChunks);
+			fn(begin, end, thread);
+		});
+	}
+
+	// nRun is the number of runs started before the worker, it waits for the next one
+	void ThreadPool::worker(int nThread, int nThreads, uint64_t nRun)
+	{
+		if (m_bAffinity)
+			Numa::pinThread(Numa::getThreadNode(nThread, nThreads));
+
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_cvStart.wait(lock, [&] { return m_bStop || m_nRun != nRun; });
+				if (m_bStop)
+					return;
+				nRun = m_nRun;
+			}
+
+			work(nThread);
+
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_nBusy--;
+			}
+			m_cvDone.notify_one();
+		}
+	}
+
+	void ThreadPool::work(int nThread)
+	{
+		if (m_bAffinity)
+		{
+			int nThreads = getThreads();
+			int begin = (int)((int64_t)m_nTasks * nThread / nThreads);
+			int end = (int)((int64_t)m_nTasks * (nThread + 1) / nThreads);
+			for (int task = begin; task < end; task++)
+				(*m_fn)(task, nThread);
+			return;
+		}
+
+		for (;;)
+		{
+			int task = m_nextTask++;
+			if (task >= m_nTasks)
+				break;
+			(*m_fn)(task, nThread);
+		}
+	}
+	// End of ThreadPool implementation
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+}
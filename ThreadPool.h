@@ -0,0 +1,59 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////
+	// ThreadPool - persistent workers for the data parallel loops of the simulation.
+	// The calling thread takes part in every run as thread 0.
+	// With affinity on, the workers are pinned to the NUMA nodes in contiguous blocks
+	// and every thread takes a fixed block of the tasks, so a loop over rows hands each
+	// thread the same rows every time.
+	class ThreadPool
+	{
+	// Construction:
+	public:
+		ThreadPool();
+		~ThreadPool();
+
+		void setThreads(int nThreads); // 0 for one thread per hardware thread
+		void setAffinity(bool bAffinity);
+
+	// Attributes:
+	public:
+		int getThreads() const { return (int)m_threads.size() + 1; }
+		bool isAffinity() const { return m_bAffinity; }
+		static int getHardwareThreads();
+
+	// Operations:
+	public:
+		// Calls fn(task, thread) for every task in [0, nTasks), thread in [0, getThreads())
+		void run(int nTasks, const std::function<void(int, int)>& fn);
+		// Calls fn(begin, end, thread) on chunks covering [0, n)
+		void parallelFor(int n, const std::function<void(int, int, int)>& fn);
+
+	// Implementation:
+	protected:
+		std::vector<std::thread> m_threads;
+		std::mutex m_mutex;
+		std::condition_variable m_cvStart;
+		std::condition_variable m_cvDone;
+		const std::function<void(int, int)>* m_fn;
+		int m_nTasks;
+		std::atomic<int> m_nextTask;
+		int m_nBusy;
+		uint64_t m_nRun;
+		bool m_bStop;
+		bool m_bAffinity;
+
+		void stop();
+		void worker(int nThread, int nThreads, uint64_t nRun);
+		void work(int nThread);
+	};
+	// End of ThreadPool
+	////////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,164 @@
+#include "pch.h"
+
+#include "Tournament.h"
+
+#include <numeric>
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Tournament implementation
+	Tournament::Tournament() : rounds(StratTable::c_rounds), repeats(5), selfPlay(true), threads(0), seed(1), m_nSimulated(0)
+	{
+	}
+
+	void Tournament::clear()
+	{
+		m_table.reset();
+		m_entrants.clear();
+		m_scores.clear();
+	}
+
+	void Tournament::add(const Strat& st)
+	{
+		Entrant e;
+		e.id = st.isGenome() ? m_table.intern(st.genome) : (TypeId)st.type;
+		if (e.id == StratTable::none)
+			return;
+		e.score = 0;
+		e.matches = 0;
+		e.rank = 0;
+		m_entrants.push_back(e);
+	}
+
+	void Tournament::addBuiltins()
+	{
+		for (int i = 0; i < (int)Strat::Type::maxType; i++)
+		{
+			// 2 is no strategy
+			if (i != 2)
+				add(Strat((Strat::Type)i));
+		}
+	}
+
+	void Tournament::addGenomes(int nGenomes, int memory, uint64_t seed)
+	{
+		Rng rng(seed);
+		for (int i = 0; i < nGenomes; i++)
+			add(Strat(Genome(std::min(std::max(memory, 1), (int)Genome::maxMemory), rng.next())));
+	}
+
+	double Tournament::getMeanScore(int entrant) const
+	{
+		const Entrant& e = m_entrants[entrant];
+		return e.matches > 0 ? (double)e.score / ((double)e.matches * rounds) : 0;
+	}
+
+	std::vector<int> Tournament::getRanking() const
+	{
+		std::vector<int> order(m_entrants.size());
+		for (size_t i = 0; i < order.size(); i++)
+			order[i] = (int)i;
+		std::stable_sort(order.begin(), order.end(), [this](int a, int b) {
+			return m_entrants[a].score > m_entrants[b].score;
+		});
+		return order;
+	}
+
+	// Total scores of nMatches matches of a against b
+	int64_t Tournament::play(TypeId a, TypeId b, int64_t& s2, int nMatches, Rng& rng)
+	{
+		Strat st1 = m_table.get(a);
+		Strat st2 = m_table.get(b);
+		int64_t s1 = 0;
+		s2 = 0;
+		for (int k = 0; k < nMatches; k++)
+		{
+			int m1, m2;
+			StratTable::simulate(st1, st2, m1, m2, rng, 0, 0, rounds);
+			s1 += m1;
+			s2 += m2;
+		}
+		return s1;
+	}
+
+	void Tournament::run()
+	{
+		NZG_PROF_SCOPE("Tournament::run");
+		m_pool.setThreads(threads);
+		int n = (int)m_entrants.size();
+		m_scores.assign((size_t)n * n, 0);
+		std::atomic<int64_t> nSimulated(0);
+
+		// Deterministic ids the entrants hold, with their index in the outcome cache
+		std::vector<int> slot(m_table.getCount(), -1);
+		std::vector<TypeId> ids;
+		for (const Entrant& e : m_entrants)
+		{
+			if (slot[e.id] < 0 && m_table.get(e.id).isDeterministic())
+			{
+				slot[e.id] = (int)ids.size();
+				ids.push_back(e.id);
+			}
+		}
+
+		// One match for every pair of them; task a writes the cells (a, b) and (b, a), b >= a
+		int nIds = (int)ids.size();
+		std::vector<int64_t> outcomes((size_t)nIds * nIds);
+		m_pool.run(nIds, [&](int a, int) {
+			Rng rng; // Not drawn from, the ids are deterministic
+			for (int b = a; b < nIds; b++)
+			{
+				int64_t s2;
+				outcomes[(size_t)a * nIds + b] = play(ids[a], ids[b], s2, 1, rng);
+				outcomes[(size_t)b * nIds + a] = s2;
+			}
+			nSimulated += nIds - a;
+		});
+
+		// Every pair of entrants; task i writes the cells (i, j) and (j, i), j >= i
+		m_pool.run(n, [&](int i, int) {
+			Rng rng(seed + i); // Per row, the same for any number of threads
+			TypeId a = m_entrants[i].id;
+			int64_t nPlayed = 0;
+			for (int j = selfPlay ? i : i + 1; j < n; j++)
+			{
+				TypeId b = m_entrants[j].id;
+				int64_t s1, s2;
+				if (slot[a] >= 0 && slot[b] >= 0)
+				{
+					s1 = repeats * outcomes[(size_t)slot[a] * nIds + slot[b]];
+					s2 = repeats * outcomes[(size_t)slot[b] * nIds + slot[a]];
+				}
+				else
+				{
+					s1 = play(a, b, s2, repeats, rng);
+					nPlayed += repeats;
+				}
+				m_scores[(size_t)i * n + j] = s1;
+				m_scores[(size_t)j * n + i] = s2;
+			}
+			nSimulated += nPlayed;
+		});
+		m_nSimulated = nSimulated;
+		NZG_PROF_COUNT(Profiler::cntSimulated, m_nSimulated);
+
+		// A match against itself counts once
+		int64_t nMatches = (int64_t)(n - 1 + (selfPlay ? 1 : 0)) * repeats;
+		for (int i = 0; i < n; i++)
+		{
+			const int64_t* pRow = m_scores.data() + (size_t)i * n;
+			m_entrants[i].score = std::accumulate(pRow, pRow + n, (int64_t)0);
+			m_entrants[i].matches = nMatches;
+		}
+
+		std::vector<int> order = getRanking();
+		for (size_t k = 0; k < order.size(); k++)
+		{
+			Entrant& e = m_entrants[order[k]];
+			e.rank = k > 0 && e.score == m_entrants[order[k - 1]].score ? m_entrants[order[k - 1]].rank : (int)k;
+		}
+	}
+	// End of Tournament implementation
+	////////////////////////////////////////////////////////////////////////////////////////////////////
+}
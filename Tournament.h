@@ -0,0 +1,66 @@
+#pragma once
+
+#include "NzgNode.h"
+
+namespace nzg
+{
+	////////////////////////////////////////////////////////////////////////////////
+	// Tournament - Axelrod's round robin: every entrant plays every other one (and
+	// itself with selfPlay) repeats matches of rounds rounds, ranked by total score.
+	// Entrants are interned into a StratTable, so identical genomes share an id, and a
+	// match between two deterministic ids is played once and counted repeats times for
+	// every pair of entrants holding them. The matches run in parallel by rows of the
+	// triangle of pairs.
+	class Tournament
+	{
+	// Construction:
+	public:
+		Tournament();
+
+		struct Entrant
+		{
+			TypeId id;		// Id in getTable()
+			int64_t score;	// Total over all matches
+			int64_t matches;
+			int rank;		// 0 for the winner, ties share the rank
+		};
+
+		void clear();
+		void add(const Strat& st);
+		void addBuiltins(); // One of every Strat::Type
+		void addGenomes(int nGenomes, int memory, uint64_t seed); // Random memory-n genomes
+
+	// Attributes:
+	public:
+		int rounds;
+		int repeats;
+		bool selfPlay;
+		int threads;	// 0 for all hardware threads
+		uint64_t seed;	// Of the draws of the stochastic entrants, one stream per row of pairs
+
+		const std::vector<Entrant>& getEntrants() const { return m_entrants; }
+		const StratTable& getTable() const { return m_table; }
+		std::string getName(int entrant) const { return m_table.get(m_entrants[entrant].id).getName(); }
+		// Total score of entrant i against entrant j
+		int64_t getScore(int i, int j) const { return m_scores[(size_t)i * m_entrants.size() + j]; }
+		double getMeanScore(int entrant) const; // Per round
+		std::vector<int> getRanking() const; // Entrants from the winner down
+		int64_t getSimulated() const { return m_nSimulated; } // Matches actually played in the last run
+
+	// Operations:
+	public:
+		void run();
+
+	// Implementation:
+	protected:
+		StratTable m_table;
+		std::vector<Entrant> m_entrants;
+		std::vector<int64_t> m_scores;
+		ThreadPool m_pool;
+		int64_t m_nSimulated;
+
+		int64_t play(TypeId a, TypeId b, int64_t& s2, int nMatches, Rng& rng);
+	};
+	// End of Tournament
+	////////////////////////////////////////////////////////////////////////////////
+}
@@ -262,6 +262,54 @@ namespace nzg
 		}
 	}
 
+	void Matrix::syr(double alpha, const double* x, int n)
+	{
+		assert(n <= rows() && n <= cols());
+		for (int i = 0; i < n; i++)
+		{
+			if (x[i] == 0.0)
+				continue;
+
+			double a = alpha * x[i];
+			double* pRow = &mat[(size_t)cs * i];
+			for (int j = i; j < n; j++)
+			{
+				pRow[j] += a * x[j];
+			}
+		}
+	}
+
+	void Matrix::syrk(double alpha, const double* x, int k, int n, const double* w)
+	{
+		assert(n <= rows() && n <= cols());
+		const int c_tile = 32;
+		for (int i0 = 0; i0 < n; i0 += c_tile)
+		{
+			int i1 = std::min(i0 + c_tile, n);
+			for (int j0 = i0; j0 < n; j0 += c_tile)
+			{
+				int j1 = std::min(j0 + c_tile, n);
+				for (int i = i0; i < i1; i++)
+				{
+					double* pRow = &mat[(size_t)cs * i];
+					int j = std::max(i, j0);
+					for (int r = 0; r < k; r++)
+					{
+						const double* px = x + (size_t)n * r;
+						if (px[i] == 0.0)
+							continue;
+
+						double a = (w != nullptr ? alpha * w[r] : alpha) * px[i];
+						for (int c = j; c < j1; c++)
+						{
+							pRow[c] += a * px[c];
+						}
+					}
+				}
+			}
+		}
+	}
+
 	Point3d Matrix::transPoint(const Point3d& pt) const
 	{
 		Point3d ptRes(NAN, NAN, NAN);
@@ -320,6 +368,168 @@ namespace nzg
 	// End of Matrix implementation
 	///////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+	///////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Cholesky implementation
+
+	Cholesky::Cholesky() : m_dLogDet(0), m_dMinPivot(0), m_dMaxPivot(0)
+	{
+	}
+
+	double Cholesky::getCondition() const
+	{
+		if (m_dMinPivot <= 0)
+			return INFINITY;
+		double d = m_dMaxPivot / m_dMinPivot;
+		return d * d;
+	}
+
+	// Right looking by panels of c_block columns: the panel is factored column by column,
+	// then the trailing lower triangle is updated by the panel, tile by tile. The rows of
+	// L are contiguous, so all the inner loops are dot products along rows
+	bool Cholesky::factor(const Matrix& a)
+	{
+		assert(a.rows() == a.cols());
+		int n = a.rows();
+		m_l.resize(n, n);
+		m_l.init(0);
+		for (int i = 0; i < n; i++)
+		{
+			for (int j = 0; j <= i; j++)
+			{
+				m_l(i, j) = a(i, j);
+			}
+		}
+		m_dLogDet = 0;
+		m_dMinPivot = INFINITY;
+		m_dMaxPivot = 0;
+
+		const int c_tile = 32;
+		for (int k0 = 0; k0 < n; k0 += c_block)
+		{
+			int k1 = std::min(k0 + (int)c_block, n);
+			for (int j = k0; j < k1; j++)
+			{
+				double* pRowJ = m_l.getRow(j);
+				double d = pRowJ[j];
+				for (int p = k0; p < j; p++)
+				{
+					d -= pRowJ[p] * pRowJ[p];
+				}
+				if (!(d > 0) || !std::isfinite(d))
+				{
+					m_dMinPivot = 0;
+					return false;
+				}
+
+				d = sqrt(d);
+				pRowJ[j] = d;
+				m_dLogDet += 2 * log(d);
+				m_dMinPivot = std::min(m_dMinPivot, d);
+				m_dMaxPivot = std::max(m_dMaxPivot, d);
+				for (int i = j + 1; i < n; i++)
+				{
+					double* pRowI = m_l.getRow(i);
+					double s = pRowI[j];
+					for (int p = k0; p < j; p++)
+					{
+						s -= pRowI[p] * pRowJ[p];
+					}
+					pRowI[j] = s / d;
+				}
+			}
+
+			for (int j0 = k1; j0 < n; j0 += c_tile)
+			{
+				int j1 = std::min(j0 + c_tile, n);
+				for (int i = j0; i < n; i++)
+				{
+					double* pRowI = m_l.getRow(i);
+					for (int j = j0; j < std::min(j1, i + 1); j++)
+					{
+						const double* pRowJ = m_l.getRow(j);
+						double s = 0;
+						for (int p = k0; p < k1; p++)
+						{
+							s += pRowI[p] * pRowJ[p];
+						}
+						pRowI[j] -= s;
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	Vector Cholesky::solve(const Vector& b) const
+	{
+		int n = size();
+		assert(b.len() == n);
+
+		// L y = b
+		Vector y(b);
+		for (int i = 0; i < n; i++)
+		{
+			const double* pRow = m_l.getRow(i);
+			double s = y[i];
+			for (int k = 0; k < i; k++)
+			{
+				s -= pRow[k] * y[k];
+			}
+			y[i] = s / pRow[i];
+		}
+
+		// LT x = y, the columns of LT being the rows of L
+		for (int i = n - 1; i >= 0; i--)
+		{
+			const double* pRow = m_l.getRow(i);
+			y[i] /= pRow[i];
+			for (int k = 0; k < i; k++)
+			{
+				y[k] -= pRow[k] * y[i];
+			}
+		}
+		return y;
+	}
+
+	// inv(A) = inv(L)T * inv(L), the sum over the rows of inv(L) of their outer products
+	void Cholesky::inverse(Matrix& q) const
+	{
+		int n = size();
+
+		// Row i of inv(L) is (ei - sum of L(i, k) * row k of inv(L), k < i) / L(i, i)
+		Matrix li(n, n);
+		for (int i = 0; i < n; i++)
+		{
+			const double* pRow = m_l.getRow(i);
+			double* pInv = li.getRow(i);
+			pInv[i] = 1.0;
+			for (int k = 0; k < i; k++)
+			{
+				const double* pInvK = li.getRow(k);
+				double d = pRow[k];
+				for (int j = 0; j <= k; j++)
+				{
+					pInv[j] -= d * pInvK[j];
+				}
+			}
+			for (int j = 0; j <= i; j++)
+			{
+				pInv[j] /= pRow[i];
+			}
+		}
+
+		q.resize(n, n);
+		q.init(0);
+		for (int k = 0; k < n; k++)
+		{
+			q.syr(1.0, li.getRow(k), k + 1);
+		}
+		q.copyUpperTriangle();
+	}
+
+	// End of Cholesky implementation
+	///////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 	///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	// HomoTransform implementation
 
@@ -77,6 +77,12 @@ namespace nzg
 			return *this;
 		}
 		void getSubVector(Vector& v, int n0, int n1) const;
+		// First n elements += alpha * x (BLAS axpy)
+		void axpy(double alpha, const double* x, int n) {
+			assert(n <= len());
+			for (int i = 0; i < n; i++)
+				data[i] += alpha * x[i];
+		}
 		double operator()(int i) const { return data[i]; }
 		double& operator()(int i) {	return data[i];	}
 		double operator[](int i) const { return data[i]; }
@@ -146,6 +152,8 @@ namespace nzg
 		}
 		double& operator()(int row, int col) {	return mat[cs* row + col];	}
 		double operator()(int row, int col) const { return mat[cs * row + col]; }
+		double* getRow(int row) { return &mat[(size_t)cs * row]; }
+		const double* getRow(int row) const { return &mat[(size_t)cs * row]; }
 		friend Vector operator*(const Matrix& m, const Vector& v) {
 			assert(m.cols() == v.len());
 			Vector r(m.rows());
@@ -182,6 +190,13 @@ namespace nzg
 		void inverse();
 		void copyUpperTriangle();
 
+		// Upper triangle (row <= col) of the leading n x n block += alpha * x * xT (BLAS syr)
+		void syr(double alpha, const double* x, int n);
+		// The same for the k rows of n values of x, one after another, row r weighted by
+		// alpha * w[r] if w is given (BLAS syrk): by tiles of N kept in cache over the batch,
+		// each element summed in the order of the rows, as syr would
+		void syrk(double alpha, const double* x, int k, int n, const double* w = nullptr);
+
 		Point3d transPoint(const Point3d& pt) const;
 
 		// Get submatrix for (nRow=nRow0; nRow<nRow1; nRow++) and for (nCol=nCol0; nCol<nCol1; nCol++)
@@ -203,7 +218,47 @@ namespace nzg
 	};
 	// End of Matrix implementation
 	////////////////////////////////////////////////////////////////////////////////
-	
+
+	////////////////////////////////////////////////////////////////////////////////
+	// Cholesky interface
+	// A = L * LT of a symmetric positive definite matrix, as the normal matrices of
+	// least squares fits are. Factored once, it gives the solution, the inverse (the
+	// cofactor matrix) and the determinant for about a third of the work of
+	// Matrix::solve and Matrix::inverse, with no pivoting needed
+	class Cholesky
+	{
+		// Construction:
+	public:
+		Cholesky();
+
+		// Attributes:
+	public:
+		int size() const { return m_l.rows(); }
+		double getLogDet() const { return m_dLogDet; } // ln det A
+		// (max Lii / min Lii)^2, a lower bound of the 2-norm condition number of A
+		double getCondition() const;
+
+		// Operations:
+	public:
+		// Factors the lower triangle of a; false if a is not positive definite
+		bool factor(const Matrix& a);
+		// A x = b
+		Vector solve(const Vector& b) const;
+		// Inverse of A into q
+		void inverse(Matrix& q) const;
+
+		// Implementation:
+	protected:
+		enum { c_block = 64 };	// Columns of a panel
+
+		Matrix m_l;
+		double m_dLogDet;
+		double m_dMinPivot;
+		double m_dMaxPivot;
+	};
+	// End of Cholesky interface
+	////////////////////////////////////////////////////////////////////////////////
+
 	///////////////////////////////////////////////////////////////////////////////
 	// HomoTransform interface
 	class HomoTransform
@@ -84,6 +84,7 @@
 #define IDS_BUILD_TAB                   300
 #define IDS_DEBUG_TAB                   301
 #define IDS_FIND_TAB                    302
+#define IDS_PROFILE_TAB                 303
 #define IDS_EXPLORER                    305
 #define IDS_EDIT_MENU                   306
 #define IDR_POPUP                       310
@@ -106,6 +107,9 @@
 #define IDC_CHECK_MASK                  1014
 #define IDC_EDIT_ISO_STEP2              1015
 #define IDC_EDIT_COLS                   1015
+#define IDC_COMBO_SCHEDULE              1016
+#define IDC_COMBO_RULE                  1017
+#define IDC_COMBO_MAP                   1018
 #define IDC_BUTTON_SAVE                 1071
 #define IDC_BUTTON_LOAD                 1072
 #define IDC_CHECK_X_AUTO                1136